@@ -0,0 +1,1046 @@
+/**************************************************************************************************
+**
+** Copyright (C) 2018 Anton Sholokhov
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+** and associated documentation files (the "Software"), to deal in the Software without restriction,
+** including without limitation the rights to use, copy, modify, merge, publish, distribute,
+** sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all copies or
+** substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+** BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+***************************************************************************************************/
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cbor-posix.h"
+
+#ifdef __linux__
+  #include <sys/sendfile.h>
+#endif
+
+#define return_if_fail(x) if((cs = (x)) != cbor_ok) { return cs; }
+
+#ifdef CBOR_HAVE_IO_URING
+  #include <linux/io_uring.h>
+  #include <sys/syscall.h>
+  #include <sys/uio.h>
+#endif
+
+// -------------------------------------------------------------------------------------------------
+
+#ifdef CBOR_ENABLE_ENCODER_SUPPORT
+
+static void *async_thread(void *arg)
+{
+  cbor_async_t *async = (cbor_async_t*)arg;
+  cbor_status cs;
+  uint8_t *data;
+  cbor_uint sz;
+
+  pthread_mutex_lock(&async->lock);
+
+  for(;;) {
+    while(async->count == 0 && !async->stop) { pthread_cond_wait(&async->filled, &async->lock); }
+    if(async->count == 0) { break; }
+
+    data = async->queue[async->head];
+    sz   = async->queuesz[async->head];
+    cs   = async->status;
+
+    async->head = (async->head + 1) % CBOR_ASYNC_MAX_BUFFERS;
+    async->count--;
+    async->busy = 1;
+
+    pthread_mutex_unlock(&async->lock);
+
+    // after an error the rest is dropped
+    if(cs == cbor_ok) { cs = async->write(data, sz, async->usrdata); }
+
+    pthread_mutex_lock(&async->lock);
+
+    if(async->status == cbor_ok) { async->status = cs; }
+    async->spare[async->nspare++] = data;
+    async->busy = 0;
+
+    pthread_cond_broadcast(&async->written);
+  }
+
+  pthread_mutex_unlock(&async->lock);
+
+  return NULL;
+}
+
+/**
+ * Wait until all queued buffers are written, call with the lock held
+*/
+static void async_drain(cbor_async_t *async)
+{
+  while(async->count > 0 || async->busy) { pthread_cond_wait(&async->written, &async->lock); }
+}
+
+/**
+ * Encoder write callback: queue the buffer and switch the encoder to a written one
+*/
+static cbor_status async_write(const void *data, cbor_uint sz, void *usrdata)
+{
+  cbor_async_t *async = (cbor_async_t*)usrdata;
+  cbor_status cs;
+  uint8_t *buf;
+
+  pthread_mutex_lock(&async->lock);
+
+  if(data != async->ctx->buf) {
+    // caller data is valid only during the call
+    async_drain(async);
+    cs = async->status;
+    pthread_mutex_unlock(&async->lock);
+
+    if(cs == cbor_ok) {
+      cs = async->write(data, sz, async->usrdata);
+
+      pthread_mutex_lock(&async->lock);
+      async->status = cs;
+      pthread_mutex_unlock(&async->lock);
+    }
+
+    return cs;
+  }
+
+  async->queue[(async->head + async->count) % CBOR_ASYNC_MAX_BUFFERS] = async->ctx->buf;
+  async->queuesz[(async->head + async->count) % CBOR_ASYNC_MAX_BUFFERS] = sz;
+  async->count++;
+
+  pthread_cond_signal(&async->filled);
+
+  while(async->nspare == 0) { pthread_cond_wait(&async->written, &async->lock); }
+
+  buf = async->spare[--async->nspare];
+  cs  = async->status;
+
+  pthread_mutex_unlock(&async->lock);
+
+  cbenc_set_buffer(async->ctx, buf, async->bufsz);
+
+  return cs;
+}
+
+static cbor_status async_sync(void *usrdata)
+{
+  cbor_async_t *async = (cbor_async_t*)usrdata;
+  cbor_status cs;
+
+  pthread_mutex_lock(&async->lock);
+  async_drain(async);
+  cs = async->status;
+  pthread_mutex_unlock(&async->lock);
+
+  return cs;
+}
+
+cbor_status cbor_async_start(cbor_async_t *async, cbenc_ctx_t *ctx, uint8_t *mem,
+                             cbor_uint bufsz, unsigned nbufs,
+                             cbor_status (*write)(const void *data, cbor_uint sz, void *usrdata),
+                             void *usrdata)
+{
+  unsigned i;
+
+  if(nbufs < 2 || nbufs > CBOR_ASYNC_MAX_BUFFERS || bufsz < CBOR_ENCODER_MIN_BUFFER_SIZE) {
+    return cbor_enomem;
+  }
+
+  async->write   = write;
+  async->usrdata = usrdata;
+  async->ctx     = ctx;
+  async->bufsz   = bufsz;
+  async->head    = 0;
+  async->count   = 0;
+  async->nspare  = 0;
+  async->busy    = 0;
+  async->stop    = 0;
+  async->status  = cbor_ok;
+
+  for(i = 1; i < nbufs; i++) { async->spare[async->nspare++] = mem + i * bufsz; }
+
+  if(pthread_mutex_init(&async->lock, NULL) != 0) { return cbor_enomem; }
+
+  if(pthread_cond_init(&async->filled, NULL) != 0) {
+    pthread_mutex_destroy(&async->lock);
+    return cbor_enomem;
+  }
+
+  if(pthread_cond_init(&async->written, NULL) != 0) {
+    pthread_cond_destroy(&async->filled);
+    pthread_mutex_destroy(&async->lock);
+    return cbor_enomem;
+  }
+
+  if(pthread_create(&async->thread, NULL, async_thread, async) != 0) {
+    pthread_cond_destroy(&async->written);
+    pthread_cond_destroy(&async->filled);
+    pthread_mutex_destroy(&async->lock);
+    return cbor_enomem;
+  }
+
+  ctx->write   = async_write;
+  ctx->sync    = async_sync;
+  ctx->usrdata = async;
+  ctx->resize  = NULL;
+  ctx->writev  = NULL;
+
+  // state of a previous use of the context refers to another buffer
+  cbenc_set_buffer(ctx, mem, bufsz);
+
+  return cbenc_begin(ctx);
+}
+
+cbor_status cbor_async_stop(cbor_async_t *async)
+{
+  cbor_status cs;
+
+  pthread_mutex_lock(&async->lock);
+  async->stop = 1;
+  pthread_cond_signal(&async->filled);
+  pthread_mutex_unlock(&async->lock);
+
+  pthread_join(async->thread, NULL);
+
+  cs = async->status;
+
+  pthread_cond_destroy(&async->written);
+  pthread_cond_destroy(&async->filled);
+  pthread_mutex_destroy(&async->lock);
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_ENCODER_SUPPORT
+
+// -------------------------------------------------------------------------------------------------
+
+#define URING_IDLE  0 // written (writer), consumed (reader)
+#define URING_BUSY  1 // in flight
+#define URING_READY 2 // filled by encoder (writer), has data (reader)
+#define URING_EOF   3 // has data up to the end of file (reader)
+
+static cbor_status file_write(int fd, const void *data, cbor_uint sz)
+{
+  const uint8_t *p = (const uint8_t*)data;
+  ssize_t n;
+
+  while(sz > 0) {
+    n = write(fd, p, sz);
+    if(n < 0 && errno == EINTR) { continue; }
+    if(n <= 0) { return cbor_eio; }
+    p  += n;
+    sz -= n;
+  }
+
+  return cbor_ok;
+}
+
+#ifdef CBOR_HAVE_IO_URING
+
+static cbor_status file_pwrite(int fd, const void *data, cbor_uint sz, uint64_t off)
+{
+  const uint8_t *p = (const uint8_t*)data;
+  ssize_t n;
+
+  while(sz > 0) {
+    n = pwrite(fd, p, sz, (off_t)off);
+    if(n < 0 && errno == EINTR) { continue; }
+    if(n <= 0) { return cbor_eio; }
+    p   += n;
+    sz  -= n;
+    off += n;
+  }
+
+  return cbor_ok;
+}
+
+static int uring_enter(cbor_uring_t *uring, unsigned submit, unsigned wait)
+{
+  int r;
+
+  do {
+    r = (int)syscall(__NR_io_uring_enter, uring->ring, submit, wait,
+                     wait? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while(r < 0 && errno == EINTR);
+
+  return r;
+}
+
+static void uring_close(cbor_uring_t *uring)
+{
+  if(uring->sqes != NULL) { munmap(uring->sqes, uring->sqessz); }
+  if(uring->cqmap != NULL && uring->cqmap != uring->sqmap) { munmap(uring->cqmap, uring->cqmapsz); }
+  if(uring->sqmap != NULL) { munmap(uring->sqmap, uring->sqmapsz); }
+
+  close(uring->ring);
+  uring->ring = -1;
+}
+
+/**
+ * Set up the ring and register the buffers, leaves ring -1 if io_uring can not be used
+*/
+static void uring_open(cbor_uring_t *uring)
+{
+  struct io_uring_params p;
+  struct iovec iov;
+  uint8_t *sq, *cq;
+  int flags = fcntl(uring->fd, F_GETFL);
+  off_t pos = lseek(uring->fd, 0, SEEK_CUR);
+
+  uring->ring  = -1;
+  uring->sqmap = NULL;
+  uring->cqmap = NULL;
+  uring->sqes  = NULL;
+
+  // offsets of writes in flight are ignored with O_APPEND
+  if(flags < 0 || (flags & O_APPEND) || pos < 0) { return; }
+
+  uring->offset = (uint64_t)pos;
+
+  memset(&p, 0, sizeof(p));
+  uring->ring = (int)syscall(__NR_io_uring_setup, 2 * uring->depth, &p);
+  if(uring->ring < 0) { uring->ring = -1; return; }
+
+  uring->sqmapsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  uring->cqmapsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  uring->sqessz  = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    if(uring->cqmapsz > uring->sqmapsz) { uring->sqmapsz = uring->cqmapsz; }
+    uring->cqmapsz = uring->sqmapsz;
+  }
+
+  uring->sqmap = mmap(NULL, uring->sqmapsz, PROT_READ | PROT_WRITE, MAP_SHARED, uring->ring,
+                      IORING_OFF_SQ_RING);
+  if(uring->sqmap == MAP_FAILED) { uring->sqmap = NULL; uring_close(uring); return; }
+
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    uring->cqmap = uring->sqmap;
+  }
+  else {
+    uring->cqmap = mmap(NULL, uring->cqmapsz, PROT_READ | PROT_WRITE, MAP_SHARED, uring->ring,
+                        IORING_OFF_CQ_RING);
+    if(uring->cqmap == MAP_FAILED) { uring->cqmap = NULL; uring_close(uring); return; }
+  }
+
+  uring->sqes = mmap(NULL, uring->sqessz, PROT_READ | PROT_WRITE, MAP_SHARED, uring->ring,
+                     IORING_OFF_SQES);
+  if(uring->sqes == MAP_FAILED) { uring->sqes = NULL; uring_close(uring); return; }
+
+  sq = (uint8_t*)uring->sqmap;
+  cq = (uint8_t*)uring->cqmap;
+
+  uring->sqhead  = (unsigned*)(sq + p.sq_off.head);
+  uring->sqtail  = (unsigned*)(sq + p.sq_off.tail);
+  uring->sqarray = (unsigned*)(sq + p.sq_off.array);
+  uring->sqmask  = *(unsigned*)(sq + p.sq_off.ring_mask);
+  uring->cqhead  = (unsigned*)(cq + p.cq_off.head);
+  uring->cqtail  = (unsigned*)(cq + p.cq_off.tail);
+  uring->cqmask  = *(unsigned*)(cq + p.cq_off.ring_mask);
+  uring->cqes    = cq + p.cq_off.cqes;
+
+  // all buffers as one registered buffer (may fail on locked memory limit)
+  iov.iov_base = uring->mem;
+  iov.iov_len  = uring->bufsz * uring->depth;
+
+  if(syscall(__NR_io_uring_register, uring->ring, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+    uring_close(uring);
+  }
+}
+
+static cbor_status uring_submit(cbor_uring_t *uring, uint8_t op, unsigned slot, uint8_t *data,
+                                cbor_uint sz, uint64_t off, uint8_t flags)
+{
+  unsigned tail = *uring->sqtail;
+  unsigned idx = tail & uring->sqmask;
+  struct io_uring_sqe *sqe = (struct io_uring_sqe*)uring->sqes + idx;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = op;
+  sqe->flags     = flags;
+  sqe->fd        = uring->fd;
+  sqe->off       = off;
+  sqe->addr      = (uintptr_t)data;
+  sqe->len       = (uint32_t)sz;
+  sqe->user_data = slot;
+
+  uring->sqarray[idx] = idx;
+  __atomic_store_n(uring->sqtail, tail + 1, __ATOMIC_RELEASE);
+
+  if(uring_enter(uring, 1, 0) != 1) { return cbor_eio; }
+
+  uring->inflight++;
+
+  return cbor_ok;
+}
+
+static void uring_complete(cbor_uring_t *uring, unsigned i, int res)
+{
+  uint8_t *buf = uring->mem + i * uring->bufsz;
+  cbor_status cs = cbor_ok;
+
+  // fsync
+  if(i == uring->depth) {
+    if(res < 0) { cs = cbor_eio; }
+  }
+  else if(uring->ctx != NULL) {
+    // write: queue the rest of short write
+    if(res <= 0) { cs = cbor_eio; }
+    else if((cbor_uint)res < uring->slot[i].len) {
+      uring->slot[i].pos += res;
+      uring->slot[i].off += res;
+      uring->slot[i].len -= res;
+
+      cs = uring_submit(uring, IORING_OP_WRITE_FIXED, i, buf + uring->slot[i].pos,
+                        uring->slot[i].len, uring->slot[i].off, 0);
+      if(cs == cbor_ok) { return; }
+    }
+
+    uring->slot[i].state = URING_IDLE;
+  }
+  else {
+    // read: queue the rest of short read
+    if(res <= 0) {
+      if(res < 0) { cs = cbor_eio; }
+      uring->slot[i].state = URING_EOF;
+    }
+    else {
+      uring->slot[i].len += res;
+      uring->slot[i].state = URING_READY;
+
+      if(uring->slot[i].len < uring->bufsz) {
+        cs = uring_submit(uring, IORING_OP_READ_FIXED, i, buf + uring->slot[i].len,
+                          uring->bufsz - uring->slot[i].len,
+                          uring->slot[i].off + uring->slot[i].len, 0);
+        uring->slot[i].state = (cs == cbor_ok)? URING_BUSY : URING_EOF;
+      }
+    }
+  }
+
+  if(uring->status == cbor_ok) { uring->status = cs; }
+}
+
+/**
+ * Wait for at least one completion
+*/
+static cbor_status uring_wait(cbor_uring_t *uring)
+{
+  unsigned head = *uring->cqhead;
+  unsigned tail = __atomic_load_n(uring->cqtail, __ATOMIC_ACQUIRE);
+  const struct io_uring_cqe *cqe;
+
+  if(head == tail) {
+    if(uring_enter(uring, 0, 1) < 0) { return cbor_eio; }
+    tail = __atomic_load_n(uring->cqtail, __ATOMIC_ACQUIRE);
+  }
+
+  for(; head != tail; head++) {
+    cqe = (const struct io_uring_cqe*)uring->cqes + (head & uring->cqmask);
+    uring->inflight--;
+    uring_complete(uring, (unsigned)cqe->user_data, cqe->res);
+  }
+
+  __atomic_store_n(uring->cqhead, head, __ATOMIC_RELEASE);
+
+  return cbor_ok;
+}
+
+#else
+
+static void uring_open(cbor_uring_t *uring)
+{
+  uring->ring = -1;
+}
+
+#endif // CBOR_HAVE_IO_URING
+
+static cbor_status uring_drain(cbor_uring_t *uring)
+{
+#ifdef CBOR_HAVE_IO_URING
+  while(uring->inflight > 0) {
+    if(uring_wait(uring) != cbor_ok) { return cbor_eio; }
+  }
+#else
+  (void)uring;
+#endif
+
+  return cbor_ok;
+}
+
+static cbor_status uring_setup(cbor_uring_t *uring, int fd, uint8_t *mem, cbor_uint bufsz,
+                               unsigned depth)
+{
+  unsigned i;
+
+  if(depth < 1 || depth > CBOR_URING_MAX_DEPTH || bufsz == 0 ||
+     (uint64_t)bufsz > UINT32_MAX) {
+    return cbor_enomem;
+  }
+
+  uring->fd       = fd;
+  uring->status   = cbor_ok;
+  uring->ctx      = NULL;
+  uring->mem      = mem;
+  uring->bufsz    = bufsz;
+  uring->depth    = depth;
+  uring->cur      = 0;
+  uring->inflight = 0;
+  uring->offset   = 0;
+  uring->syncsz   = 0;
+  uring->unsynced = 0;
+  uring->seek     = 0;
+
+  for(i = 0; i < depth; i++) {
+    uring->slot[i].off   = 0;
+    uring->slot[i].pos   = 0;
+    uring->slot[i].len   = 0;
+    uring->slot[i].state = URING_IDLE;
+  }
+
+  uring_open(uring);
+
+  return cbor_ok;
+}
+
+#ifdef CBOR_ENABLE_ENCODER_SUPPORT
+
+/**
+ * Encoder write callback: queue the buffer and switch the encoder to a written one
+*/
+static cbor_status uring_write(const void *data, cbor_uint sz, void *usrdata)
+{
+  cbor_uring_t *uring = (cbor_uring_t*)usrdata;
+#ifdef CBOR_HAVE_IO_URING
+  cbenc_ctx_t *ctx = (cbenc_ctx_t*)uring->ctx;
+  cbor_status cs;
+  unsigned i;
+#endif
+
+  if(uring->ring < 0) {
+    if(uring->status == cbor_ok) { uring->status = file_write(uring->fd, data, sz); }
+    return uring->status;
+  }
+
+#ifdef CBOR_HAVE_IO_URING
+  if(uring->seek) {
+    // the file may be written by others after cbenc_end
+    off_t pos = lseek(uring->fd, 0, SEEK_CUR);
+    if(pos < 0) { return cbor_eio; }
+    uring->offset = (uint64_t)pos;
+    uring->seek = 0;
+  }
+
+  if(data != ctx->buf) {
+    // caller data is valid only during the call
+    return_if_fail(uring_drain(uring));
+
+    if(uring->status == cbor_ok) {
+      uring->status = file_pwrite(uring->fd, data, sz, uring->offset);
+      uring->offset += sz;
+    }
+
+    return uring->status;
+  }
+
+  i = (unsigned)((ctx->buf - uring->mem) / uring->bufsz);
+
+  uring->slot[i].off   = uring->offset;
+  uring->slot[i].pos   = 0;
+  uring->slot[i].len   = sz;
+  uring->slot[i].state = URING_BUSY;
+
+  return_if_fail(uring_submit(uring, IORING_OP_WRITE_FIXED, i, ctx->buf, sz, uring->offset, 0));
+
+  uring->offset   += sz;
+  uring->unsynced += sz;
+
+  if(uring->syncsz > 0 && uring->unsynced >= uring->syncsz) {
+    // drain orders the fsync after the writes in flight
+    return_if_fail(uring_submit(uring, IORING_OP_FSYNC, uring->depth, NULL, 0, 0,
+                                IOSQE_IO_DRAIN));
+    uring->unsynced = 0;
+  }
+
+  for(;;) {
+    for(i = 0; i < uring->depth && uring->slot[i].state != URING_IDLE; i++) { }
+    if(i < uring->depth) { break; }
+    return_if_fail(uring_wait(uring));
+  }
+
+  uring->slot[i].state = URING_READY;
+  cbenc_set_buffer(ctx, uring->mem + i * uring->bufsz, uring->bufsz);
+#endif
+
+  return uring->status;
+}
+
+static cbor_status uring_sync(void *usrdata)
+{
+  cbor_uring_t *uring = (cbor_uring_t*)usrdata;
+  cbor_status cs;
+
+  if(uring->ring < 0) {
+    if(uring->syncsz > 0 && uring->status == cbor_ok && fsync(uring->fd) != 0) {
+      uring->status = cbor_eio;
+    }
+    return uring->status;
+  }
+
+#ifdef CBOR_HAVE_IO_URING
+  if(uring->syncsz > 0 && uring->unsynced > 0) {
+    return_if_fail(uring_submit(uring, IORING_OP_FSYNC, uring->depth, NULL, 0, 0,
+                                IOSQE_IO_DRAIN));
+    uring->unsynced = 0;
+  }
+#endif
+
+  return_if_fail(uring_drain(uring));
+
+  // writes have explicit offsets, leave the file position after them for other writers (without
+  // writes since the last sync the position may be already moved by them)
+  if(!uring->seek && lseek(uring->fd, (off_t)uring->offset, SEEK_SET) < 0 &&
+     uring->status == cbor_ok) {
+    uring->status = cbor_eio;
+  }
+  uring->seek = 1;
+
+  return uring->status;
+}
+
+cbor_status cbor_uring_write_start(cbor_uring_t *uring, cbenc_ctx_t *ctx, int fd, uint8_t *mem,
+                                   cbor_uint bufsz, unsigned depth, cbor_uint syncsz)
+{
+  cbor_status cs = cbor_ok;
+
+  if(depth < 2 || bufsz < CBOR_ENCODER_MIN_BUFFER_SIZE) { return cbor_enomem; }
+
+  return_if_fail(uring_setup(uring, fd, mem, bufsz, depth));
+
+  uring->ctx    = ctx;
+  uring->syncsz = syncsz;
+  uring->slot[0].state = URING_READY;
+
+  ctx->write   = uring_write;
+  ctx->sync    = uring_sync;
+  ctx->usrdata = uring;
+  ctx->resize  = NULL;
+  ctx->writev  = NULL;
+
+  // state of a previous use of the context refers to another buffer
+  cbenc_set_buffer(ctx, mem, bufsz);
+
+  return cbenc_begin(ctx);
+}
+
+#endif // CBOR_ENABLE_ENCODER_SUPPORT
+
+#ifdef CBOR_ENABLE_DECODER_SUPPORT
+
+cbor_status cbor_uring_read_start(cbor_uring_t *uring, int fd, uint8_t *mem, cbor_uint bufsz,
+                                  unsigned depth)
+{
+  cbor_status cs = cbor_ok;
+
+  return_if_fail(uring_setup(uring, fd, mem, bufsz, depth));
+
+#ifdef CBOR_HAVE_IO_URING
+  if(uring->ring >= 0) {
+    unsigned i;
+
+    for(i = 0; i < depth && cs == cbor_ok; i++) {
+      uring->slot[i].off   = uring->offset;
+      uring->slot[i].state = URING_BUSY;
+      uring->offset += bufsz;
+
+      cs = uring_submit(uring, IORING_OP_READ_FIXED, i, mem + i * bufsz, bufsz,
+                        uring->slot[i].off, 0);
+    }
+
+    if(cs != cbor_ok) {
+      uring_drain(uring);
+      uring_close(uring);
+    }
+  }
+#endif
+
+  return cs;
+}
+
+cbor_status cbor_uring_fill(void *data, cbor_uint *sz, void *usrdata)
+{
+  cbor_uring_t *uring = (cbor_uring_t*)usrdata;
+  cbor_status cs = cbor_ok;
+  cbor_uint got = 0;
+  ssize_t r;
+
+  if(uring->ring < 0) {
+    do { r = read(uring->fd, data, *sz); } while(r < 0 && errno == EINTR);
+    if(r < 0) { return cbor_eio; }
+    *sz = (cbor_uint)r;
+    return cbor_ok;
+  }
+
+#ifdef CBOR_HAVE_IO_URING
+  while(got < *sz) {
+    unsigned i = uring->cur;
+    cbor_uint n;
+
+    while(uring->slot[i].state == URING_BUSY) { return_if_fail(uring_wait(uring)); }
+    return_if_fail(uring->status);
+
+    n = uring->slot[i].len - uring->slot[i].pos;
+    if(n > *sz - got) { n = *sz - got; }
+
+    memcpy((uint8_t*)data + got, uring->mem + i * uring->bufsz + uring->slot[i].pos, n);
+    uring->slot[i].pos += n;
+    got += n;
+
+    if(uring->slot[i].pos < uring->slot[i].len) { break; }
+    if(uring->slot[i].state == URING_EOF) { break; }
+
+    // consumed buffer reads the next part of the file
+    uring->slot[i].off   = uring->offset;
+    uring->slot[i].pos   = 0;
+    uring->slot[i].len   = 0;
+    uring->slot[i].state = URING_BUSY;
+    uring->offset += uring->bufsz;
+    uring->cur = (i + 1) % uring->depth;
+
+    return_if_fail(uring_submit(uring, IORING_OP_READ_FIXED, i, uring->mem + i * uring->bufsz,
+                                uring->bufsz, uring->slot[i].off, 0));
+  }
+#endif
+
+  *sz = got;
+
+  return cs;
+}
+
+cbor_status cbor_uring_read(void *data, cbor_uint sz, void *usrdata)
+{
+  cbor_status cs = cbor_ok;
+  uint8_t *p = (uint8_t*)data;
+  cbor_uint n;
+
+  while(sz > 0) {
+    n = sz;
+    return_if_fail(cbor_uring_fill(p, &n, usrdata));
+    if(n == 0) { return cbor_eos; }
+    p  += n;
+    sz -= n;
+  }
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_DECODER_SUPPORT
+
+cbor_status cbor_uring_stop(cbor_uring_t *uring)
+{
+  if(uring->ring < 0) { return uring->status; }
+
+#ifdef CBOR_HAVE_IO_URING
+  if(uring_drain(uring) != cbor_ok) { uring->status = cbor_eio; }
+
+  if(uring->ctx == NULL) {
+    // reader: after the consumed data
+    uring->offset = uring->slot[uring->cur].off + uring->slot[uring->cur].pos;
+  }
+
+  if(!uring->seek) { lseek(uring->fd, (off_t)uring->offset, SEEK_SET); }
+  uring_close(uring);
+#endif
+
+  return uring->status;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+#ifdef CBOR_ENABLE_DECODER_SUPPORT
+
+#define MMAP_HUGEPAGE_SIZE ((size_t)2 << 20)
+
+/**
+ * Map len bytes of file at address aligned to huge page size
+ *
+ * @brief len is rounded up to the page size, the whole mapping is unmapped with it.
+*/
+static void *mmap_huge(int fd, size_t *len)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  uint8_t *area, *p;
+  size_t head;
+
+  if(*len > SIZE_MAX - MMAP_HUGEPAGE_SIZE - page) { return MAP_FAILED; }
+  *len = (*len + page - 1) / page * page;
+
+  // reserve address range with space for alignment, then map the file over its aligned part
+  area = (uint8_t*)mmap(NULL, *len + MMAP_HUGEPAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+  if(area == MAP_FAILED) { return MAP_FAILED; }
+
+  head = (MMAP_HUGEPAGE_SIZE - (uintptr_t)area % MMAP_HUGEPAGE_SIZE) % MMAP_HUGEPAGE_SIZE;
+  p = (uint8_t*)mmap(area + head, *len, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0);
+
+  // unmapping of already released parts does nothing
+  if(p == MAP_FAILED || (head > 0 && munmap(area, head) != 0) ||
+     munmap(p + *len, MMAP_HUGEPAGE_SIZE - head) != 0) {
+    munmap(area, *len + MMAP_HUGEPAGE_SIZE);
+    return MAP_FAILED;
+  }
+
+#ifdef MADV_HUGEPAGE
+  madvise(p, *len, MADV_HUGEPAGE);
+#endif
+
+  return p;
+}
+
+cbor_status cbor_mmap_open(cbor_mmap_t *map, cbdec_ctx_t *ctx, int fd, unsigned flags)
+{
+  cbdec_ctx_t mem = CBOR_DECODER_MEM_CTX_INITIALIZER(NULL, 0);
+  struct stat st;
+  void *p;
+
+  *ctx = mem;
+
+  map->data = NULL;
+  map->size = 0;
+  map->addr = NULL;
+  map->len  = 0;
+
+  if(fstat(fd, &st) != 0 || st.st_size < 0 || (uint64_t)st.st_size > CBOR_UINT_MAX ||
+     (uint64_t)st.st_size > SIZE_MAX) {
+    return cbor_eio;
+  }
+
+  if(st.st_size > 0) {
+    map->len = (size_t)st.st_size;
+
+    if(flags & CBOR_MMAP_HUGEPAGE) { p = mmap_huge(fd, &map->len); }
+    else { p = mmap(NULL, map->len, PROT_READ, MAP_SHARED, fd, 0); }
+
+    if(p == MAP_FAILED) { map->len = 0; return cbor_eio; }
+
+    if(flags & CBOR_MMAP_SEQUENTIAL) { madvise(p, map->len, MADV_SEQUENTIAL); }
+    if(flags & CBOR_MMAP_RANDOM) { madvise(p, map->len, MADV_RANDOM); }
+
+    map->addr = p;
+    map->data = (const uint8_t*)p;
+    map->size = (cbor_uint)st.st_size;
+  }
+
+  return cbor_mmap_seek(map, ctx, 0, 0);
+}
+
+/**
+ * Reset decoder to memory decoder over data, keeping its settings
+*/
+static void mmap_decoder(cbdec_ctx_t *ctx, const uint8_t *data, cbor_uint sz)
+{
+  cbdec_ctx_t mem = CBOR_DECODER_MEM_CTX_INITIALIZER(data, sz);
+
+  mem.utf8 = ctx->utf8;
+  *ctx = mem;
+}
+
+cbor_status cbor_mmap_seek(cbor_mmap_t *map, cbdec_ctx_t *ctx, cbor_uint off, cbor_uint sz)
+{
+  uintptr_t page, start;
+
+  if(off > map->size) { return cbor_eos; }
+
+  if(sz > map->size - off) { sz = map->size - off; }
+
+  if(sz > 0) {
+    // madvise takes page aligned address
+    page  = (uintptr_t)sysconf(_SC_PAGESIZE);
+    start = (uintptr_t)(map->data + off) / page * page;
+    madvise((void*)start, (uintptr_t)(map->data + off + sz) - start, MADV_WILLNEED);
+  }
+
+  mmap_decoder(ctx, map->data + off, map->size - off);
+
+  return cbor_ok;
+}
+
+cbor_uint cbor_mmap_tell(const cbor_mmap_t *map, const cbdec_ctx_t *ctx)
+{
+  return (cbor_uint)(ctx->pos - map->data);
+}
+
+cbor_status cbor_mmap_close(cbor_mmap_t *map)
+{
+  cbor_status cs = cbor_ok;
+
+  if(map->addr != NULL && munmap(map->addr, map->len) != 0) { cs = cbor_eio; }
+
+  map->data = NULL;
+  map->size = 0;
+  map->addr = NULL;
+  map->len  = 0;
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_DECODER_SUPPORT
+
+// -------------------------------------------------------------------------------------------------
+
+#define FD_BUFFER_SIZE 16384 // stack buffer of the copy loops
+#define FD_CHUNK_SIZE  ((size_t)1 << 30) // transfer size per call
+
+/**
+ * Read up to *sz bytes from offset (or current position if off is NULL)
+*/
+static cbor_status fd_read(int fd, void *data, size_t *sz, off_t *off)
+{
+  ssize_t n;
+
+  do {
+    n = (off != NULL)? pread(fd, data, *sz, *off) : read(fd, data, *sz);
+  } while(n < 0 && errno == EINTR);
+
+  if(n < 0) { return cbor_eio; }
+  if(n == 0) { return cbor_eos; }
+
+  if(off != NULL) { *off += n; }
+  *sz = (size_t)n;
+
+  return cbor_ok;
+}
+
+/**
+ * Move sz bytes from srcfd to dstfd, copy through buf of FD_BUFFER_SIZE bytes if the kernel can not
+*/
+static cbor_status fd_transfer(int dstfd, int srcfd, off_t *off, cbor_uint sz, uint8_t *buf)
+{
+  cbor_status cs = cbor_ok;
+  size_t len;
+
+#ifdef __linux__
+  // copy_file_range between files, sendfile from file, splice to or from pipe
+  int method = 0;
+  ssize_t n;
+
+  while(sz > 0 && method < 3) {
+    len = (sz > FD_CHUNK_SIZE)? FD_CHUNK_SIZE : (size_t)sz;
+
+    switch(method) {
+    case 0:  n = copy_file_range(srcfd, off, dstfd, NULL, len, 0); break;
+    case 1:  n = sendfile(dstfd, srcfd, off, len); break;
+    default: n = splice(srcfd, off, dstfd, NULL, len, SPLICE_F_MOVE); break;
+    }
+
+    if(n < 0 && errno == EINTR) { continue; }
+
+    if(n < 0) {
+      // not supported for these descriptors, try the next way
+      if(errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EBADF ||
+         errno == EOPNOTSUPP || errno == ESPIPE) {
+        method++;
+        continue;
+      }
+      return cbor_eio;
+    }
+
+    if(n == 0) { return cbor_eos; }
+
+    sz -= n;
+  }
+#endif
+
+  while(sz > 0) {
+    len = (sz > FD_BUFFER_SIZE)? FD_BUFFER_SIZE : (size_t)sz;
+    return_if_fail(fd_read(srcfd, buf, &len, off));
+    return_if_fail(file_write(dstfd, buf, len));
+    sz -= len;
+  }
+
+  return cs;
+}
+
+#ifdef CBOR_ENABLE_ENCODER_SUPPORT
+
+cbor_status cbenc_bytestr_fd(cbenc_ctx_t *ctx, int dstfd, int srcfd, off_t off, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+  off_t *offp = (off >= 0)? &off : NULL;
+  uint8_t buf[FD_BUFFER_SIZE];
+  size_t len;
+
+  return_if_fail(cbenc_bytestr_begin_sz(ctx, sz));
+
+  // measure mode only counts the data, srcfd is not read
+  if(cbenc_measuring(ctx)) { return cbenc_sbypass(ctx, sz); }
+
+  cs = cbenc_sbypass(ctx, sz);
+
+  if(cs == cbor_ok) { return fd_transfer(dstfd, srcfd, offp, sz, buf); }
+  if(cs != cbor_eagain) { return cs; }
+
+  // data stays in the encoder buffer
+  while(sz > 0) {
+    len = (sz > sizeof(buf))? sizeof(buf) : (size_t)sz;
+    return_if_fail(fd_read(srcfd, buf, &len, offp));
+    return_if_fail(cbenc_swrite(ctx, buf, len));
+    sz -= len;
+  }
+
+  return cbor_ok;
+}
+
+#endif // CBOR_ENABLE_ENCODER_SUPPORT
+
+#ifdef CBOR_ENABLE_DECODER_SUPPORT
+
+cbor_status cbdec_sread_fd(cbdec_ctx_t *ctx, int srcfd, int dstfd)
+{
+  cbor_status cs = cbor_ok;
+  uint8_t buf[FD_BUFFER_SIZE];
+  const void *data;
+  cbor_uint n;
+
+  while(ctx->value.u > 0) {
+    n  = ctx->value.u;
+    cs = cbdec_sbypass(ctx, n);
+
+    if(cs == cbor_ok) { return fd_transfer(dstfd, srcfd, NULL, n, buf); }
+    if(cs != cbor_eagain) { return cs; }
+
+    if(ctx->read != NULL) {
+      // read callback decoder views data by 8 bytes, read it in larger parts
+      if(n > sizeof(buf)) { n = sizeof(buf); }
+      return_if_fail(cbdec_sread(ctx, buf, n));
+      data = buf;
+    }
+    else {
+      return_if_fail(cbdec_sview(ctx, &data, &n));
+    }
+
+    return_if_fail(file_write(dstfd, data, n));
+  }
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_DECODER_SUPPORT
@@ -0,0 +1,320 @@
+/**************************************************************************************************
+**
+** Copyright (C) 2018 Anton Sholokhov
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+** and associated documentation files (the "Software"), to deal in the Software without restriction,
+** including without limitation the rights to use, copy, modify, merge, publish, distribute,
+** sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all copies or
+** substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+** BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+***************************************************************************************************/
+#ifndef _CBOR_POSIX_H_
+#define _CBOR_POSIX_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include "cbor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -------------------------------------------------------------------------------------------------
+
+#ifdef CBOR_ENABLE_ENCODER_SUPPORT
+
+#define CBOR_ASYNC_MAX_BUFFERS 8
+
+typedef struct cbor_async
+{
+  // public:
+  cbor_status (*write)(const void *data, cbor_uint sz, void *usrdata); // data write callback
+  void *usrdata; // user data pointer
+
+  // private:
+  cbenc_ctx_t *ctx;
+  cbor_uint bufsz;
+  uint8_t *queue[CBOR_ASYNC_MAX_BUFFERS]; // filled buffers, in write order
+  cbor_uint queuesz[CBOR_ASYNC_MAX_BUFFERS];
+  uint8_t *spare[CBOR_ASYNC_MAX_BUFFERS]; // written buffers
+  unsigned head;
+  unsigned count;
+  unsigned nspare;
+  int busy;
+  int stop;
+  cbor_status status;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t written;
+} cbor_async_t;
+
+/**
+ * Start background writing for encoder
+ *
+ * @param  async   - background writer
+ * @param  ctx     - encoder context, its write, sync, usrdata and buffer are set and encoding
+ *                   is started (cbenc_begin) by this call
+ * @param  mem     - ptr to memory for nbufs buffers
+ * @param  bufsz   - buffer size (min 9 bytes!)
+ * @param  nbufs   - number of buffers, 2 .. CBOR_ASYNC_MAX_BUFFERS
+ * @param  write   - data write callback, called from the writer thread
+ * @param  usrdata - ptr to user data for write callback
+ * @return status code
+ *
+ * @brief  The encoder fills one buffer while the writer thread writes the others. When all of
+ *         them wait for writing, a flush blocks until one is written. cbenc_end waits until all
+ *         data is written and returns the first write error. Data written past the buffer (long
+ *         strings) is written by the encoder thread, after the queued buffers.
+*/
+cbor_status cbor_async_start(cbor_async_t *async, cbenc_ctx_t *ctx, uint8_t *mem,
+                             cbor_uint bufsz, unsigned nbufs,
+                             cbor_status (*write)(const void *data, cbor_uint sz, void *usrdata),
+                             void *usrdata);
+
+/**
+ * Stop background writing
+ *
+ * @param  async - background writer
+ * @return status code: the first write error
+ *
+ * @note   Waits for queued buffers, the encoder context must not be used after this call.
+*/
+cbor_status cbor_async_stop(cbor_async_t *async);
+
+#endif // CBOR_ENABLE_ENCODER_SUPPORT
+
+// -------------------------------------------------------------------------------------------------
+
+#define CBOR_URING_MAX_DEPTH 16
+
+typedef struct cbor_uring
+{
+  // private:
+  int fd;
+  int ring; // io_uring descriptor, -1 when reading or writing directly
+  cbor_status status;
+  void *ctx;
+  uint8_t *mem;
+  cbor_uint bufsz;
+  unsigned depth;
+  unsigned cur;
+  unsigned inflight;
+  uint64_t offset;
+  cbor_uint syncsz;
+  cbor_uint unsynced;
+  int seek;
+  struct {
+    uint64_t off;
+    cbor_uint pos;
+    cbor_uint len;
+    int state;
+  } slot[CBOR_URING_MAX_DEPTH];
+  unsigned *sqhead;
+  unsigned *sqtail;
+  unsigned *sqarray;
+  unsigned sqmask;
+  unsigned *cqhead;
+  unsigned *cqtail;
+  unsigned cqmask;
+  void *sqes;
+  void *cqes;
+  void *sqmap;
+  void *cqmap;
+  size_t sqmapsz;
+  size_t cqmapsz;
+  size_t sqessz;
+} cbor_uring_t;
+
+#ifdef CBOR_ENABLE_ENCODER_SUPPORT
+
+/**
+ * Start io_uring writing of encoded data to file
+ *
+ * @param  uring  - file writer
+ * @param  ctx    - encoder context, its write, sync, usrdata and buffer are set and encoding is
+ *                  started (cbenc_begin) by this call
+ * @param  fd     - file descriptor, written from its current position
+ * @param  mem    - ptr to memory for depth buffers
+ * @param  bufsz  - buffer size (min 9 bytes!)
+ * @param  depth  - number of buffers, 2 .. CBOR_URING_MAX_DEPTH
+ * @param  syncsz - fsync after each syncsz bytes and on cbenc_end, 0 to not sync
+ * @return status code
+ *
+ * @brief  Buffers are registered with the ring, the encoder fills one while the others are
+ *         written. When all of them are being written, a flush waits for one. cbenc_end waits for
+ *         all writes, sets the file position after them and returns the first error. Without
+ *         io_uring (not built, not supported by the kernel, O_APPEND or not seekable file) the
+ *         encoder writes directly from the first buffer.
+*/
+cbor_status cbor_uring_write_start(cbor_uring_t *uring, cbenc_ctx_t *ctx, int fd, uint8_t *mem,
+                                   cbor_uint bufsz, unsigned depth, cbor_uint syncsz);
+
+#endif // CBOR_ENABLE_ENCODER_SUPPORT
+
+#ifdef CBOR_ENABLE_DECODER_SUPPORT
+
+/**
+ * Start io_uring reading of file
+ *
+ * @param  uring - file reader
+ * @param  fd    - file descriptor, read from its current position
+ * @param  mem   - ptr to memory for depth buffers
+ * @param  bufsz - buffer size
+ * @param  depth - number of reads in flight, 1 .. CBOR_URING_MAX_DEPTH
+ * @return status code
+ *
+ * @brief  Reads depth buffers ahead, a consumed buffer is queued again for the next part of the
+ *         file. Pass the reader as usrdata with cbor_uring_fill or cbor_uring_read callback.
+ *         Without io_uring the callbacks read the file directly.
+*/
+cbor_status cbor_uring_read_start(cbor_uring_t *uring, int fd, uint8_t *mem, cbor_uint bufsz,
+                                  unsigned depth);
+
+/**
+ * Decoder callbacks reading from cbor_uring_read_start
+ *
+ * @brief  cbor_uring_fill is the read-ahead callback (CBOR_DECODER_BUF_CTX_INITIALIZER),
+ *         cbor_uring_read is the read callback (CBOR_DECODER_CTX_INITIALIZER).
+*/
+cbor_status cbor_uring_fill(void *data, cbor_uint *sz, void *usrdata);
+cbor_status cbor_uring_read(void *data, cbor_uint sz, void *usrdata);
+
+#endif // CBOR_ENABLE_DECODER_SUPPORT
+
+/**
+ * Stop io_uring reading or writing
+ *
+ * @param  uring - file reader or writer
+ * @return status code: the first I/O error
+ *
+ * @note   Waits for reads and writes in flight. The file position is set after the written or
+ *         consumed data.
+*/
+cbor_status cbor_uring_stop(cbor_uring_t *uring);
+
+// -------------------------------------------------------------------------------------------------
+
+#ifdef CBOR_ENABLE_DECODER_SUPPORT
+
+#define CBOR_MMAP_SEQUENTIAL 0x01 // scan: aggressive read-ahead, pages behind may be dropped early
+#define CBOR_MMAP_RANDOM     0x02 // jumps: no read-ahead, cbor_mmap_seek prefetches the range
+#define CBOR_MMAP_HUGEPAGE   0x04 // align the mapping to huge pages and ask for them
+
+typedef struct cbor_mmap
+{
+  // public:
+  const uint8_t *data; // mapped file (read only!)
+  cbor_uint size; // file size (read only!)
+
+  // private:
+  void *addr;
+  size_t len;
+} cbor_mmap_t;
+
+/**
+ * Map file and set up memory decoder over it
+ *
+ * @param  map   - file mapping
+ * @param  ctx   - decoder context, set to memory decoder over the whole file
+ * @param  fd    - file descriptor, may be closed after this call
+ * @param  flags - CBOR_MMAP_* hints
+ * @return status code
+ *
+ * @brief  No read callback is used, cbdec_sview returns string data as pointers into the
+ *         mapping, valid until cbor_mmap_close. A file changed by others while mapped gives
+ *         undefined data, truncated one may raise SIGBUS.
+*/
+cbor_status cbor_mmap_open(cbor_mmap_t *map, cbdec_ctx_t *ctx, int fd, unsigned flags);
+
+/**
+ * Move decoder to file offset
+ *
+ * @param  map - file mapping
+ * @param  ctx - decoder context, reset to memory decoder from off to the end of file
+ * @param  off - offset of an item, e.g. from cbor_mmap_tell
+ * @param  sz  - number of bytes expected to be read from there, prefetched with MADV_WILLNEED
+ * @return status code: cbor_eos for offset past the end of file
+ *
+ * @note   ctx->utf8 is kept.
+*/
+cbor_status cbor_mmap_seek(cbor_mmap_t *map, cbdec_ctx_t *ctx, cbor_uint off, cbor_uint sz);
+
+/**
+ * Get file offset of the next byte the decoder reads
+ *
+ * @param  map - file mapping
+ * @param  ctx - decoder context, set up by cbor_mmap_open or cbor_mmap_seek
+ * @return offset, after cbdec_step it is the end of the item header
+*/
+cbor_uint cbor_mmap_tell(const cbor_mmap_t *map, const cbdec_ctx_t *ctx);
+
+/**
+ * Unmap file
+ *
+ * @param  map - file mapping
+ * @return status code
+*/
+cbor_status cbor_mmap_close(cbor_mmap_t *map);
+
+#endif // CBOR_ENABLE_DECODER_SUPPORT
+
+// -------------------------------------------------------------------------------------------------
+
+#ifdef CBOR_ENABLE_ENCODER_SUPPORT
+
+/**
+ * Encode file range as byte string
+ *
+ * @param  ctx   - encoder context
+ * @param  dstfd - file descriptor the encoder output goes to
+ * @param  srcfd - file descriptor to take data from
+ * @param  off   - offset in srcfd, -1 for its current position (pipes, sockets)
+ * @param  sz    - data size
+ * @return status code: cbor_eos if srcfd ends before sz bytes
+ *
+ * @brief  Encodes the header and writes encoded data (cbenc_sbypass), then moves the data from
+ *         srcfd to dstfd in the kernel with copy_file_range, sendfile or splice, whichever the
+ *         descriptors allow, otherwise through a buffer. Growable buffer and data inside
+ *         containers opened by cbenc_array_open or cbenc_map_open get the data read into the
+ *         buffer, measure mode only counts it.
+*/
+cbor_status cbenc_bytestr_fd(cbenc_ctx_t *ctx, int dstfd, int srcfd, off_t off, cbor_uint sz);
+
+#endif // CBOR_ENABLE_ENCODER_SUPPORT
+
+#ifdef CBOR_ENABLE_DECODER_SUPPORT
+
+/**
+ * Move the rest of string data to file descriptor
+ *
+ * @param  ctx   - decoder context
+ * @param  srcfd - file descriptor the decoder reads, with read or fill callback reading it
+ *                 without buffering of its own (not stdio or cbor_uring_fill)
+ * @param  dstfd - file descriptor to write data to
+ * @return status code
+ *
+ * @brief  Data in decoder memory is written from there (cbdec_sview), the rest is moved from
+ *         srcfd to dstfd in the kernel with copy_file_range, sendfile or splice, whichever the
+ *         descriptors allow, otherwise through a buffer. Memory and segments decoders do not use
+ *         srcfd.
+*/
+cbor_status cbdec_sread_fd(cbdec_ctx_t *ctx, int srcfd, int dstfd);
+
+#endif // CBOR_ENABLE_DECODER_SUPPORT
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // _CBOR_POSIX_H_
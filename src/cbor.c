@@ -77,6 +77,15 @@
 
 #endif // _MSC_VER
 
+#if defined(CBOR_ENABLE_SIMD_SUPPORT) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+  // SSE4.1 and AVX2 code paths, selected at run time
+  #include <immintrin.h>
+  #include <cpuid.h>
+  #define CBOR_X86_SIMD
+  #define CBOR_TARGET(isa) __attribute__((target(isa)))
+#endif
+
 enum sub_type
 {
   st_size8  = 24,
@@ -88,18 +97,412 @@ enum sub_type
 
 #define return_if_fail(x) if((cs = (x)) != cbor_ok) { return cs; }
 
+static inline uint16_t load16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static inline uint32_t load32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t load64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+#ifdef CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+/**
+ * Get element size of typed array
+ *
+ * @param  tag - CBOR tag value
+ * @return size in bytes, zero if the tag is not a typed array one
+*/
+static inline cbor_uint typed_size(cbor_uint tag)
+{
+  // 76 (int8, little endian) is reserved
+  if(tag < cbor_tag_ta_u8 || tag > cbor_tag_ta_f128le || tag == 76) { return 0; }
+
+  // tag bits: 0b010fsell, f - float, s - signed, e - little endian, ll - size
+  return (tag & 0x10)? (cbor_uint)2 << (tag & 3) : (cbor_uint)1 << (tag & 3);
+}
+
+/**
+ * Check that typed array byte order differs from the host one
+*/
+static inline int typed_swap(cbor_uint tag)
+{
+#ifdef CBOR_BIG_ENDIAN
+  return typed_size(tag) > 1 && (tag & 4) != 0;
+#else
+  return typed_size(tag) > 1 && (tag & 4) == 0;
+#endif
+}
+
+#ifdef CBOR_X86_SIMD
+
+// pshufb masks reversing bytes of 2, 4, 8 and 16 byte elements
+static const uint8_t bswap_masks[4][16] =
+{
+  {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+  {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+  {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+  {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0}
+};
+
+CBOR_TARGET("ssse3")
+static size_t bswap_ssse3(uint8_t *dst, const uint8_t *src, size_t sz, const uint8_t *mask)
+{
+  const __m128i m = _mm_loadu_si128((const __m128i*)mask);
+  size_t i;
+
+  for(i = 0; i + 16 <= sz; i += 16) {
+    _mm_storeu_si128((__m128i*)(dst + i),
+                     _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), m));
+  }
+
+  return i;
+}
+
+CBOR_TARGET("avx2")
+static size_t bswap_avx2(uint8_t *dst, const uint8_t *src, size_t sz, const uint8_t *mask)
+{
+  // elements never cross 128-bit lanes, so in-lane shuffle is enough
+  const __m256i m = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)mask));
+  size_t i;
+
+  for(i = 0; i + 32 <= sz; i += 32) {
+    _mm256_storeu_si256((__m256i*)(dst + i),
+                        _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + i)), m));
+  }
+
+  return i;
+}
+
+#endif // CBOR_X86_SIMD
+
+/**
+ * Reverse byte order of every element
+ *
+ * @param dst   - ptr to destination (may be equal to src)
+ * @param src   - ptr to elements
+ * @param count - number of elements
+ * @param size  - element size: 2, 4, 8 or 16 bytes
+*/
+static void bswap_array(void *dst, const void *src, size_t count, size_t size)
+{
+  const uint8_t *s = (const uint8_t*)src;
+  uint8_t *d = (uint8_t*)dst, tmp[16];
+  size_t i = 0, k, sz = count * size;
+
+#ifdef CBOR_X86_SIMD
+  const uint8_t *mask = bswap_masks[(size == 2)? 0 : (size == 4)? 1 : (size == 8)? 2 : 3];
+
+  if(sz >= 32 && __builtin_cpu_supports("avx2")) { i = bswap_avx2(d, s, sz, mask); }
+  else
+  if(sz >= 16 && __builtin_cpu_supports("ssse3")) { i = bswap_ssse3(d, s, sz, mask); }
+#endif
+
+  for(; i < sz; i += size) {
+    for(k = 0; k < size; k++) { tmp[k] = s[i + size - 1 - k]; }
+    memcpy(d + i, tmp, size);
+  }
+}
+
+#endif // CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+
+/**
+ * Get length of UTF-8 sequence by its lead byte (only for bytes >= 0xC0)
+*/
+static inline size_t utf8_seqlen(uint8_t c)
+{
+  return (c >= 0xF0)? 4 : (c >= 0xE0)? 3 : 2;
+}
+
+#endif // CBOR_ENABLE_UTF8_SUPPORT
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+
+/**
+ * Convert float32 to float16, rounding to nearest even (as F16C does)
+ *
+ * @param  f - float32 bits
+ * @return float16 bits
+*/
+static uint16_t encode_float16(uint32_t f)
+{
+  uint32_t sign = (f >> 16) & 0x8000u, a = f & 0x7FFFFFFFu, m, r, s;
+
+  if(a >= 0x47800000u) {
+    // overflow is infinity, NaN is quiet with the upper payload bits
+    return sign | ((a > 0x7F800000u)? 0x7E00u | ((a >> 13) & 0x3FFu) : 0x7C00u);
+  }
+
+  if(a < 0x38800000u) {
+    // subnormal or zero: the value is m * 2^-24 shifted right by s
+    s = 126 - (a >> 23);
+    if(s > 24) { return sign; }
+
+    m = (a & 0x7FFFFFu) | 0x800000u;
+    r = m >> s;
+    m &= (1u << s) - 1;
+
+    // carry into the exponent makes the smallest normal number, which is right
+    return sign | (r + (m > (1u << (s - 1)) || (m == (1u << (s - 1)) && (r & 1))));
+  }
+
+  // rebias the exponent, an overflow to infinity by rounding is right too
+  return sign | ((a - 0x38000000u + 0xFFFu + ((a >> 13) & 1)) >> 13);
+}
+
+/**
+ * Convert float16 to float32 (exact), NaN is made quiet as F16C does
+ *
+ * @param  h - float16 bits
+ * @return float32 bits
+*/
+static uint32_t decode_float16(uint16_t h)
+{
+  uint32_t sign = ((uint32_t)h & 0x8000u) << 16, a = h & 0x7FFFu;
+  union { float f; uint32_t u; } v;
+
+  if(a >= 0x7C00u) {
+    return sign | 0x7F800000u | ((a & 0x3FFu) << 13) | ((a & 0x3FFu)? 0x400000u : 0);
+  }
+
+  if(a < 0x400u) {
+    // subnormal or zero is a * 2^-24, which is exact in float32
+    v.f = (float)a * 5.9604644775390625e-8f;
+    return sign | v.u;
+  }
+
+  return sign | ((a << 13) + 0x38000000u);
+}
+
+#ifdef CBOR_X86_SIMD
+
+/**
+ * Check F16C support (older compilers do not know it in __builtin_cpu_supports)
+*/
+static int f16c_supported(void)
+{
+  // every thread computes the same value, so the race is harmless
+  static int f16c = -1;
+  unsigned a, b, c, d;
+
+  if(f16c < 0) {
+    f16c = __builtin_cpu_supports("avx") && __get_cpuid(1, &a, &b, &c, &d) && (c & bit_F16C);
+  }
+
+  return f16c;
+}
+
+CBOR_TARGET("avx,f16c")
+static size_t f16_encode_f16c(uint16_t *dst, const float *src, size_t count)
+{
+  size_t i;
+
+  for(i = 0; i + 8 <= count; i += 8) {
+    _mm_storeu_si128((__m128i*)(dst + i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+
+  return i;
+}
+
+CBOR_TARGET("avx,f16c")
+static size_t f16_decode_f16c(float *dst, const uint16_t *src, size_t count)
+{
+  size_t i;
+
+  for(i = 0; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+  }
+
+  return i;
+}
+
+#endif // CBOR_X86_SIMD
+
+void cbor_float16_encode(uint16_t *dst, const float *src, cbor_uint count)
+{
+  union { float f; uint32_t u; } v;
+  size_t i = 0;
+
+#ifdef CBOR_X86_SIMD
+  if(count >= 8 && f16c_supported()) { i = f16_encode_f16c(dst, src, count); }
+#endif
+
+  for(; i < count; i++) {
+    v.f = src[i];
+    dst[i] = encode_float16(v.u);
+  }
+}
+
+void cbor_float16_decode(float *dst, const uint16_t *src, cbor_uint count)
+{
+  union { float f; uint32_t u; } v;
+  size_t i = 0;
+
+#ifdef CBOR_X86_SIMD
+  if(count >= 8 && f16c_supported()) { i = f16_decode_f16c(dst, src, count); }
+#endif
+
+  for(; i < count; i++) {
+    v.u = decode_float16(src[i]);
+    dst[i] = v.f;
+  }
+}
+
+#endif // CBOR_ENABLE_FLOAT32_SUPPORT
+
 #ifdef CBOR_ENABLE_ENCODER_SUPPORT
 
 static inline cbor_uint encbuf_datalen(cbenc_ctx_t *ctx) { return ctx->end - ctx->buf; }
 static inline cbor_uint encbuf_avail(cbenc_ctx_t *ctx) { return ctx->bufsz - encbuf_datalen(ctx); }
 
+/**
+ * Pass data to the write callback (measure mode only counts it)
+*/
+static inline cbor_status encbuf_write(cbenc_ctx_t *ctx, const void *data, cbor_uint sz)
+{
+  cbor_iovec_t iov;
+
+  ctx->size += sz;
+
+  if(ctx->writev != NULL) {
+    iov.base = data;
+    iov.len  = sz;
+    return ctx->writev(&iov, 1, ctx->usrdata);
+  }
+
+  return cbenc_measuring(ctx)? cbor_ok : ctx->write(data, sz, ctx->usrdata);
+}
+
+/**
+ * Add buffer data not listed yet to the segment list of vectored output
+*/
+static inline void encbuf_segment(cbenc_ctx_t *ctx)
+{
+  if(ctx->end > ctx->seg) {
+    ctx->iov[ctx->iovcnt].base = ctx->seg;
+    ctx->iov[ctx->iovcnt].len  = ctx->end - ctx->seg;
+    ctx->iovcnt++;
+    ctx->seg = ctx->end;
+  }
+}
+
+/**
+ * Pass all segments of vectored output in one writev call and reuse the buffer
+*/
+static cbor_status encbuf_flushv(cbenc_ctx_t *ctx)
+{
+  cbor_status cs = cbor_ok;
+
+  encbuf_segment(ctx);
+
+  if(ctx->iovcnt > 0) { cs = ctx->writev(ctx->iov, ctx->iovcnt, ctx->usrdata); }
+
+  // referenced data is counted when listed
+  ctx->size  += encbuf_datalen(ctx);
+  ctx->iovcnt = 0;
+  ctx->end    = ctx->buf;
+  ctx->seg    = ctx->buf;
+
+  return cs;
+}
+
+/**
+ * List caller data as a segment of vectored output, without copying
+*/
+static cbor_status encbuf_ref(cbenc_ctx_t *ctx, const void *data, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  // one entry is kept for the buffer data that follows
+  if(ctx->iovcnt + 3 > ctx->iovmax) { return_if_fail(encbuf_flushv(ctx)); }
+
+  encbuf_segment(ctx);
+
+  ctx->iov[ctx->iovcnt].base = data;
+  ctx->iov[ctx->iovcnt].len  = sz;
+  ctx->iovcnt++;
+  ctx->size += sz;
+
+  return cs;
+}
+
+/**
+ * Resize growable buffer to have at least size bytes available
+*/
+static cbor_status encbuf_resize(cbenc_ctx_t *ctx, cbor_uint size)
+{
+  cbor_uint len = encbuf_datalen(ctx), sz = ctx->bufsz * 2;
+  uint8_t *buf;
+
+  if(len + size < len) { return cbor_enomem; }
+  if(sz < ctx->bufsz || sz < len + size) { sz = len + size; }
+
+  buf = (uint8_t*)ctx->resize(ctx->buf, sz, ctx->usrdata);
+  if(buf == NULL) { return cbor_enomem; }
+
+  if(ctx->buf != NULL) { ctx->mem = buf + (ctx->mem - ctx->buf); }
+  ctx->buf   = buf;
+  ctx->end   = buf + len;
+  ctx->bufsz = sz;
+
+  return cbor_ok;
+}
+
+/**
+ * Check that data of open containers is held in the buffer (write and vectored output only)
+*/
+static inline int encbuf_held(cbenc_ctx_t *ctx)
+{
+  return (ctx->write || ctx->writev) && ctx->opened > 0;
+}
+
+/**
+ * Flush the buffer
+ *
+ * @param  ctx - encoder context
+ * @return status code
+*/
+static cbor_status encbuf_flush(cbenc_ctx_t *ctx)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint len = encbuf_datalen(ctx);
+
+  // open containers are patched on close, so their data stays in the buffer
+  if(encbuf_held(ctx)) { len = ctx->marks[0] - ctx->size; }
+
+  if(ctx->writev != NULL && !encbuf_held(ctx)) { return encbuf_flushv(ctx); }
+
+  // growable buffer keeps all the data
+  if(ctx->resize == NULL && len > 0) {
+    uint8_t *data = ctx->buf;
+    cbor_uint rest = encbuf_datalen(ctx) - len;
+
+    // write callback may switch to another buffer with cbenc_set_buffer
+    cs = encbuf_write(ctx, data, len);
+    memmove(ctx->buf, data + len, rest);
+    ctx->end = ctx->buf + rest;
+  }
+
+  return cs;
+}
+
 static inline cbor_status encbuf_grow(cbenc_ctx_t *ctx, cbor_uint size)
 {
   cbor_status cs = cbor_ok;
 
   if(encbuf_avail(ctx) < size) {
-    cs = ctx->write(ctx->buf, encbuf_datalen(ctx), ctx->usrdata);
-    ctx->end = ctx->buf;
+    if(ctx->resize != NULL) {
+      return_if_fail(encbuf_resize(ctx, size));
+    }
+    else if(cbenc_measuring(ctx)) {
+      ctx->size += size;
+      // items are encoded to scratch to count them, its content is never used
+      ctx->mem = ctx->scratch;
+      return cs;
+    }
+    else {
+      cs = encbuf_flush(ctx);
+      if(encbuf_avail(ctx) < size) { return cbor_enomem; }
+    }
   }
 
   ctx->mem  = ctx->end;
@@ -108,6 +511,64 @@ static inline cbor_status encbuf_grow(cbenc_ctx_t *ctx, cbor_uint size)
   return cs;
 }
 
+/**
+ * Make space for size bytes: flush the buffer or resize growable one
+ *
+ * @brief After flush the buffer is available up to data of open containers, which may still
+ *        be less than size.
+*/
+static cbor_status encbuf_room(cbenc_ctx_t *ctx, cbor_uint size)
+{
+  if(ctx->resize != NULL) { return encbuf_resize(ctx, size); }
+
+  return encbuf_flush(ctx);
+}
+
+/**
+ * Write item header to p without space checks
+ *
+ * @param  p    - ptr to buffer with at least 9 bytes of space
+ * @param  type - major type
+ * @param  val  - argument
+ * @return ptr past the header
+*/
+static inline uint8_t *enc_head(uint8_t *p, uint8_t type, cbor_uint val)
+{
+#ifdef CBOR_INTTYPE_64
+  // argument size class 0 - 4 and size 0, 1, 2, 4, 8 bytes, without branches
+  unsigned k = (val >= 24) + (val > 0xFF) + (val > 0xFFFF) + (val > 0xFFFFFFFFUL);
+  unsigned n = (1u << k) >> 1;
+  uint64_t be = cbor_bswap64(val << ((64 - 8 * n) & 63));
+
+  p[0] = type | (uint8_t)(k? st_size8 - 1 + k : val);
+  memcpy(p + 1, &be, 8);
+
+  return p + 1 + n;
+#else
+  if(val < 24) { p[0] = type | val; return p + 1; }
+
+  #ifdef CBOR_INTTYPE_16
+  if(val > 0xFF) {
+    #ifdef CBOR_INTTYPE_32
+    if(val > 0xFFFF) {
+      p[0] = type | st_size32;
+      *(uint32_t*)(&p[1]) = cbor_bswap32(val);
+      return p + 5;
+    }
+    #endif
+
+    p[0] = type | st_size16;
+    *(uint16_t*)(&p[1]) = cbor_bswap16(val);
+    return p + 3;
+  }
+  #endif
+
+  p[0] = type | st_size8;
+  p[1] = val;
+  return p + 2;
+#endif
+}
+
 static inline cbor_status cbenc_header(cbenc_ctx_t *ctx, uint8_t type, cbor_uint grow)
 {
   cbor_status cs = cbor_ok;
@@ -131,21 +592,80 @@ static inline cbor_status cbenc_bytes(cbenc_ctx_t *ctx, uint8_t type, const void
   return cbenc_swrite(ctx, data, sz);
 }
 
-cbor_status cbenc_begin(cbenc_ctx_t *ctx) { ctx->end = ctx->buf; return cbor_ok; }
+cbor_status cbenc_begin(cbenc_ctx_t *ctx)
+{
+  cbor_uint reserve = ctx->bufsz;
+
+  if(cbenc_measuring(ctx)) {
+    // measure mode has no buffer, the data is counted as written
+    ctx->buf   = ctx->scratch;
+    ctx->bufsz = 0;
+  }
+
+  ctx->end    = ctx->buf;
+  ctx->seg    = ctx->buf;
+  ctx->size   = 0;
+  ctx->opened = 0;
+  ctx->iovcnt = 0;
+
+  if(ctx->resize != NULL && ctx->buf == NULL) {
+    // bufsz of growable buffer is the reserve hint until the first allocation
+    ctx->bufsz = 0;
+    return encbuf_resize(ctx, reserve > CBOR_ENCODER_MIN_BUFFER_SIZE?
+                              reserve : CBOR_ENCODER_MIN_BUFFER_SIZE);
+  }
+
+  return cbor_ok;
+}
 
 cbor_status cbenc_end(cbenc_ctx_t *ctx)
 {
-  cbor_status cs = cbor_ok;
-  cbor_uint len = encbuf_datalen(ctx);
+  cbor_status cs = encbuf_flush(ctx);
 
-  if(len > 0) {
-    cs = ctx->write(ctx->buf, len, ctx->usrdata);
-    ctx->end = ctx->buf;
+  if(ctx->sync != NULL) {
+    cbor_status scs = ctx->sync(ctx->usrdata);
+    if(cs == cbor_ok) { cs = scs; }
   }
 
   return cs;
 }
 
+cbor_status cbenc_release(cbenc_ctx_t *ctx, void **data, cbor_uint *sz)
+{
+  *data = ctx->buf;
+  *sz   = encbuf_datalen(ctx);
+
+  // bufsz stays as the reserve hint for the next buffer
+  ctx->buf = NULL;
+  ctx->end = NULL;
+  ctx->mem = NULL;
+
+  return cbor_ok;
+}
+
+cbor_uint cbenc_size(cbenc_ctx_t *ctx)
+{
+  return ctx->size + encbuf_datalen(ctx);
+}
+
+void cbenc_set_buffer(cbenc_ctx_t *ctx, uint8_t *buf, cbor_uint bufsz)
+{
+  ctx->buf   = buf;
+  ctx->bufsz = bufsz;
+  ctx->seg   = buf;
+}
+
+cbor_status cbenc_reserve(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  if(encbuf_avail(ctx) >= sz || cbenc_measuring(ctx)) { return cs; }
+
+  return_if_fail(encbuf_room(ctx, sz));
+
+  return (encbuf_avail(ctx) >= sz)? cs : cbor_enomem;
+}
+
 cbor_status cbenc_uint(cbenc_ctx_t *ctx, cbor_uint val)
 {
   cbor_status cs = cbor_ok;
@@ -207,59 +727,106 @@ cbor_status cbenc_int(cbenc_ctx_t *ctx, cbor_int val)
   return cs;
 }
 
-#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
-
 /**
- * Convert float32 to float16
+ * Get number of array items that surely fit into the buffer, flush it if none
  *
- * @param h - float32 bits
- * @return float16 bits
- *
- * @note
- *   source from: http://gamedev.stackexchange.com/questions/17326/conversion-of-a-number-from-
- *                single-precision-floating-point-representation-to-a
-*/
-static uint16_t encode_float16(uint32_t h)
-{
-  uint16_t bits = (h >> 16) & 0x8000; /* Get the sign */
-  uint16_t m = (h >> 12) & 0x7FF; /* Keep one extra bit for rounding */
-  unsigned int e = (h >> 23) & 0xFF; /* Using int is faster here */
-
-  /* If zero, or denormal, or exponent underflows too much for a denormal
-   * half, return signed zero. */
-  if(e >= 103) {
-    /* If NaN, return NaN. If Inf or exponent overflow, return Inf. */
-    if(e > 142) {
-      bits |= 0x7C00u;
-      /* If exponent was 0xff and one mantissa bit was set, it means NaN,
-       * not Inf, so make sure we set one mantissa bit too. */
-      bits |= e == 255 && (h & 0x7FFFFFu);
-    }
-    else
-    /* If exponent underflows but not too much, return a denormal */
-    if(e < 113) {
-      m |= 0x800u;
-      /* Extra rounding may overflow and set mantissa to 0 and exponent
-       * to 1, which is OK. */
-      bits |= (m >> (114 - e)) + ((m >> (113 - e)) & 1);
-    }
-    else {
-      bits |= ((e - 112) << 10) | (m >> 1);
-      /* Extra rounding. An overflow will set mantissa to 0 and increment
-       * the exponent, which is OK. */
-      bits += m & 1;
-    }
-  }
+ * @brief Item size is the longest header, CBOR_ENCODER_MIN_BUFFER_SIZE, so after flush at least
+ *        one item fits.
+*/
+static cbor_status encbuf_batch(cbenc_ctx_t *ctx, cbor_uint item_size, cbor_uint *n)
+{
+  cbor_status cs = cbor_ok;
+
+  *n = encbuf_avail(ctx) / item_size;
+
+  if(*n == 0) {
+    return_if_fail(encbuf_room(ctx, item_size));
+    *n = encbuf_avail(ctx) / item_size;
+    if(*n == 0) { return cbor_enomem; }
+  }
+
+  return cs;
+}
+
+cbor_status cbenc_uint_array(cbenc_ctx_t *ctx, const cbor_uint *vals, cbor_uint count)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint i, n;
+  uint8_t *p, tmp[CBOR_ENCODER_MIN_BUFFER_SIZE];
+
+  return_if_fail(cbenc_array(ctx, count));
+
+  if(cbenc_measuring(ctx)) {
+    for(i = 0, n = 0; i < count; i++) { n += enc_head(tmp, cbor_tuint, vals[i]) - tmp; }
+    ctx->size += n;
+    return cs;
+  }
+
+  while(count) {
+    return_if_fail(encbuf_batch(ctx, CBOR_ENCODER_MIN_BUFFER_SIZE, &n));
+    if(n > count) { n = count; }
+
+    p = ctx->end;
+    for(i = 0; i < n; i++) { p = enc_head(p, cbor_tuint, vals[i]); }
+    ctx->end = p;
+
+    vals  += n;
+    count -= n;
+  }
+
+  return cs;
+}
+
+cbor_status cbenc_int_array(cbenc_ctx_t *ctx, const cbor_int *vals, cbor_uint count)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint i, n, sign;
+  uint8_t *p, tmp[CBOR_ENCODER_MIN_BUFFER_SIZE];
+
+  return_if_fail(cbenc_array(ctx, count));
+
+  if(cbenc_measuring(ctx)) {
+    for(i = 0, n = 0; i < count; i++) {
+      sign = (cbor_uint)0 - (vals[i] < 0);
+      n += enc_head(tmp, sign & cbor_tint, (cbor_uint)vals[i] ^ sign) - tmp;
+    }
+    ctx->size += n;
+    return cs;
+  }
 
-  return bits;
+  while(count) {
+    return_if_fail(encbuf_batch(ctx, CBOR_ENCODER_MIN_BUFFER_SIZE, &n));
+    if(n > count) { n = count; }
+
+    p = ctx->end;
+    for(i = 0; i < n; i++) {
+      // all ones for negative value: ~val is the argument of cbor_tint
+      sign = (cbor_uint)0 - (vals[i] < 0);
+      p = enc_head(p, sign & cbor_tint, (cbor_uint)vals[i] ^ sign);
+    }
+    ctx->end = p;
+
+    vals  += n;
+    count -= n;
+  }
+
+  return cs;
 }
 
+#ifdef CBOR_ENABLE_FLOAT_ZERO_AS_UINT
+  #define FLOAT_AS_UINT(bits) ((bits) == 0)
+#else
+  #define FLOAT_AS_UINT(bits) ((void)(bits), 0)
+#endif
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+
 cbor_status cbenc_float16(cbenc_ctx_t *ctx, float val)
 {
   cbor_status cs = cbor_ok;
   union { float f; uint32_t bits; } v = { val };
 
-  if(v.bits == 0) { return cbenc_uint(ctx, 0); }
+  if(FLOAT_AS_UINT(v.bits)) { return cbenc_uint(ctx, 0); }
 
   return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size16, 2));
 
@@ -268,478 +835,2212 @@ cbor_status cbenc_float16(cbenc_ctx_t *ctx, float val)
   return cs;
 }
 
+cbor_status cbenc_float16_array(cbenc_ctx_t *ctx, const float *vals, cbor_uint count)
+{
+  cbor_status cs = cbor_ok;
+  union { float f; uint32_t u; } v;
+  uint16_t half[64];
+  cbor_uint i, n;
+  uint8_t *p;
+
+  return_if_fail(cbenc_array(ctx, count));
+
+  if(cbenc_measuring(ctx)) {
+    for(i = 0, n = 0; i < count; i++) {
+      v.f = vals[i];
+      n += FLOAT_AS_UINT(v.u)? 1 : 3;
+    }
+    ctx->size += n;
+    return cs;
+  }
+
+  while(count) {
+    return_if_fail(encbuf_batch(ctx, 3, &n));
+    if(n > count) { n = count; }
+    if(n > 64) { n = 64; }
+
+    cbor_float16_encode(half, vals, n);
+
+    p = ctx->end;
+    for(i = 0; i < n; i++) {
+      v.f  = vals[i];
+      p[0] = FLOAT_AS_UINT(v.u)? 0 : cbor_tsimple | st_size16;
+      p[1] = half[i] >> 8;
+      p[2] = half[i] & 0xFF;
+      p += p[0]? 3 : 1;
+    }
+    ctx->end = p;
+
+    vals  += n;
+    count -= n;
+  }
+
+  return cs;
+}
+
 cbor_status cbenc_float32(cbenc_ctx_t *ctx, float val)
 {
   cbor_status cs = cbor_ok;
   union { float f; uint32_t u; } v = { val };
 
-  if(v.u == 0) { return cbenc_uint(ctx, 0); }
+  if(FLOAT_AS_UINT(v.u)) { return cbenc_uint(ctx, 0); }
+
+  return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size32, 4));
+  *(uint32_t*)(&ctx->mem[1]) = cbor_bswap32(v.u);
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_FLOAT32_SUPPORT
+
+#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
+
+cbor_status cbenc_float64(cbenc_ctx_t *ctx, double val)
+{
+  cbor_status cs = cbor_ok;
+  union { double f; uint64_t u; } v = { val };
+
+  if(FLOAT_AS_UINT(v.u)) { return cbenc_uint(ctx, 0); }
+
+  return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size64, 8));
+  *(uint64_t*)(&ctx->mem[1]) = cbor_bswap64(v.u);
+
+  return cs;
+}
+
+cbor_status cbenc_float64_array(cbenc_ctx_t *ctx, const double *vals, cbor_uint count)
+{
+  cbor_status cs = cbor_ok;
+  union { double f; uint64_t u; } v;
+  cbor_uint i, n;
+  uint8_t *p;
+
+  return_if_fail(cbenc_array(ctx, count));
+
+  if(cbenc_measuring(ctx)) {
+    for(i = 0, n = 0; i < count; i++) {
+      v.f = vals[i];
+      n += FLOAT_AS_UINT(v.u)? 1 : 9;
+    }
+    ctx->size += n;
+    return cs;
+  }
+
+  while(count) {
+    return_if_fail(encbuf_batch(ctx, CBOR_ENCODER_MIN_BUFFER_SIZE, &n));
+    if(n > count) { n = count; }
+
+    p = ctx->end;
+    for(i = 0; i < n; i++) {
+      v.f  = vals[i];
+      p[0] = FLOAT_AS_UINT(v.u)? 0 : cbor_tsimple | st_size64;
+      v.u  = cbor_bswap64(v.u);
+      memcpy(p + 1, &v.u, 8);
+      p += p[0]? 9 : 1;
+    }
+    ctx->end = p;
+
+    vals  += n;
+    count -= n;
+  }
+
+  return cs;
+}
+
+/**
+ * Get the shortest float that holds a double value exactly
+ *
+ * @param  d    - float64 bits
+ * @param  bits - float16 or float32 bits, if the value fits one
+ * @return float size: 2, 4 or 8 bytes
+ *
+ * @brief  The value fits if its exponent is in range and the mantissa bits the shorter float
+ *         lacks are zero. NaN keeps its payload, so it fits only if the payload does.
+*/
+static int float_shortest(uint64_t d, uint32_t *bits)
+{
+  uint32_t sign = (uint32_t)(d >> 32) & 0x80000000u;
+  uint64_t m = d & 0xFFFFFFFFFFFFFull;
+  int e = (int)(d >> 52) & 0x7FF, s;
+
+  if(e == 0x7FF) {
+    // infinity or NaN
+    if((m & 0x3FFFFFFFFFFull) == 0) {
+      *bits = (sign >> 16) | 0x7C00u | (uint32_t)(m >> 42);
+      return 2;
+    }
+    if((m & 0x1FFFFFFFu) == 0) {
+      *bits = sign | 0x7F800000u | (uint32_t)(m >> 29);
+      return 4;
+    }
+    return 8;
+  }
+
+  if(e == 0) {
+    // zero, float64 subnormals are too small for float32
+    *bits = sign >> 16;
+    return m? 8 : 2;
+  }
+
+  e -= 1023;
+  m |= (uint64_t)1 << 52;
+
+  if(e >= -24 && e <= 15) {
+    // half normal keeps 10 mantissa bits, subnormal (exponent below -14) less
+    s = (e >= -14)? 42 : 28 - e;
+    if((m & (((uint64_t)1 << s) - 1)) == 0) {
+      *bits = (sign >> 16) |
+              ((e >= -14)? ((uint32_t)(e + 15) << 10) | ((uint32_t)(m >> 42) & 0x3FFu) :
+                           (uint32_t)(m >> s));
+      return 2;
+    }
+  }
+
+  if(e >= -149 && e <= 127) {
+    // float normal keeps 23 mantissa bits, subnormal (exponent below -126) less
+    s = (e >= -126)? 29 : -97 - e;
+    if((m & (((uint64_t)1 << s) - 1)) == 0) {
+      *bits = sign |
+              ((e >= -126)? ((uint32_t)(e + 127) << 23) | ((uint32_t)(m >> 29) & 0x7FFFFFu) :
+                            (uint32_t)(m >> s));
+      return 4;
+    }
+  }
+
+  return 8;
+}
+
+cbor_status cbenc_float(cbenc_ctx_t *ctx, double val)
+{
+  cbor_status cs = cbor_ok;
+  union { double f; uint64_t u; } v = { val };
+  uint32_t bits;
+
+  if(FLOAT_AS_UINT(v.u)) { return cbenc_uint(ctx, 0); }
+
+  switch(float_shortest(v.u, &bits)) {
+  case 2:
+    return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size16, 2));
+    *(uint16_t*)(&ctx->mem[1]) = cbor_bswap16((uint16_t)bits);
+    break;
+
+  case 4:
+    return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size32, 4));
+    *(uint32_t*)(&ctx->mem[1]) = cbor_bswap32(bits);
+    break;
+
+  default:
+    return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size64, 8));
+    *(uint64_t*)(&ctx->mem[1]) = cbor_bswap64(v.u);
+    break;
+  }
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_FLOAT64_SUPPORT
+
+cbor_status cbenc_simple(cbenc_ctx_t *ctx, cbor_simple val)
+{
+  return cbenc_header(ctx, cbor_tsimple | val, 0);
+}
+
+cbor_status cbenc_bytestr_begin(cbenc_ctx_t *ctx)
+{
+  return cbenc_header(ctx, cbor_tbytestr | st_varbrk, 0);
+}
+
+cbor_status cbenc_bytestr(cbenc_ctx_t *ctx, const void *data, cbor_uint sz)
+{
+  return cbenc_bytes(ctx, cbor_tbytestr, data, sz);
+}
+
+cbor_status cbenc_textstr_begin(cbenc_ctx_t *ctx)
+{
+  return cbenc_header(ctx, cbor_ttextstr | st_varbrk, 0);
+}
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+
+#ifdef CBOR_X86_SIMD
+
+/**
+ * Vectorised part of utf8_ascii. Loads stay within limit bytes, the tail is left to the caller.
+*/
+CBOR_TARGET("sse2")
+static const uint8_t *utf8_ascii_sse2(const uint8_t *p, size_t limit)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v;
+  unsigned mask;
+
+  for(; limit >= 16; p += 16, limit -= 16) {
+    v = _mm_loadu_si128((const __m128i*)p);
+    mask = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero)));
+    if(mask) { return p + __builtin_ctz(mask); }
+  }
+
+  return p;
+}
+
+CBOR_TARGET("avx2")
+static const uint8_t *utf8_ascii_avx2(const uint8_t *p, size_t limit)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i v;
+  unsigned mask;
+
+  for(; limit >= 32; p += 32, limit -= 32) {
+    v = _mm256_loadu_si256((const __m256i*)p);
+    mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(v, _mm256_cmpeq_epi8(v, zero)));
+    if(mask) { return p + __builtin_ctz(mask); }
+  }
+
+  return p;
+}
+
+#endif // CBOR_X86_SIMD
+
+/**
+ * Get length of ASCII run (bytes 0x01 - 0x7F)
+ *
+ * @param  s     - ptr to data
+ * @param  limit - max length
+ * @param  safe  - number of bytes known to be readable, vector loads stay within it
+ * @return run length
+*/
+static size_t utf8_ascii(const uint8_t *s, cbor_uint limit, size_t safe)
+{
+  const uint8_t *p = s;
+
+#ifdef CBOR_X86_SIMD
+  if(safe > limit) { safe = limit; }
+
+  if(safe >= 64) {
+    if(__builtin_cpu_supports("avx2")) { p = utf8_ascii_avx2(p, safe); }
+    else
+    if(__builtin_cpu_supports("sse2")) { p = utf8_ascii_sse2(p, safe); }
+
+    limit -= p - s;
+  }
+#else
+  (void)safe;
+#endif
+
+  while(limit && *p && *p < 0x80) { p++; limit--; }
+  return p - s;
+}
+
+/**
+ * Get the longest UTF-8 prefix of c-string
+ *
+ * @param  s          - ptr to c-string
+ * @param  char_limit - max number of characters
+ * @param  safe       - number of bytes known to be readable
+ * @return ptr to the end of prefix
+ *
+ * @note   Only the structure of sequences is checked (up to 6 bytes, as the lead byte tells), not
+ *         the code points they encode.
+*/
+static const char *utf8_truncate(const uint8_t *s, cbor_uint char_limit, size_t safe)
+{
+  const uint8_t *start = s;
+  size_t n, i, pos;
+
+#ifndef CBOR_INTTYPE_64
+  cbor_uint byte_limit = CBOR_UINT_MAX;
+#endif
+
+  while(*s && char_limit) {
+    if(*s < 0x80) {
+      pos = s - start;
+      n = utf8_ascii(s, char_limit, (pos < safe)? safe - pos : 0);
+
+#ifndef CBOR_INTTYPE_64
+      if(n > byte_limit) { n = byte_limit; }
+      if(n == 0) { break; }
+      byte_limit -= n;
+#endif
+
+      s += n;
+      char_limit -= n;
+      continue;
+    }
+
+    if     ((*s & 0xE0) == 0xC0) { n = 2; }
+    else if((*s & 0xF0) == 0xE0) { n = 3; }
+    else if((*s & 0xF8) == 0xF0) { n = 4; }
+    else if((*s & 0xFC) == 0xF8) { n = 5; }
+    else if((*s & 0xFE) == 0xFC) { n = 6; }
+    else                         { break; }
+
+#ifndef CBOR_INTTYPE_64
+    if(byte_limit < n) { break; }
+    byte_limit -= n;
+#endif
+
+    for(i = 1; i < n; i++) {
+      if((s[i] & 0xC0) != 0x80) { return (const char*)s; }
+    }
+
+    s += n;
+    char_limit--;
+  }
+
+  return (const char*)s;
+}
+
+#endif // CBOR_ENABLE_UTF8_SUPPORT
+
+cbor_status cbenc_textstr(cbenc_ctx_t *ctx, const char *data, cbor_uint sz)
+{
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+  const char *end = utf8_truncate((uint8_t*)data, sz, sz);
+  return cbenc_bytes(ctx, cbor_ttextstr, data, end - data);
+#else
+  return cbenc_bytes(ctx, cbor_ttextstr, data, sz);
+#endif
+}
+
+cbor_status cbenc_cstring(cbenc_ctx_t *ctx, const char *data)
+{
+  cbor_status cs = cbor_ok;
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+  const char *str = data;
+  size_t len = strlen(data);
+  const char *end = utf8_truncate((uint8_t*)data, CBOR_UINT_MAX, len);
+
+  // a malformed sequence ends the string, as no chunk can be made of it
+  if(*end == 0 || utf8_truncate((uint8_t*)end, 1, len - (end - str)) == end) {
+    return cbenc_bytes(ctx, cbor_ttextstr, data, end - data);
+  }
+
+  return_if_fail(cbenc_header(ctx, cbor_ttextstr | st_varbrk, 0));
+
+  do {
+    return_if_fail(cbenc_bytes(ctx, cbor_ttextstr, data, end - data));
+    data = end;
+    end  = utf8_truncate((uint8_t*)data, CBOR_UINT_MAX, len - (data - str));
+  } while(*end && end > data);
+
+  if(end > data) { return_if_fail(cbenc_bytes(ctx, cbor_ttextstr, data, end - data)); }
+
+  return cbenc_break(ctx);
+#else
+  size_t len, n;
+
+  len = strlen(data);
+
+  if(len > CBOR_UINT_MAX) {
+    return_if_fail(cbenc_header(ctx, cbor_ttextstr | st_varbrk, 0));
+
+    while(len) {
+      n = (len > CBOR_UINT_MAX)? CBOR_UINT_MAX : len;
+      return_if_fail(cbenc_bytes(ctx, cbor_ttextstr, data, n));
+      len -= n; data += n;
+    }
+
+    return cbenc_break(ctx);
+  }
+
+  return cbenc_bytes(ctx, cbor_ttextstr, data, len);
+#endif
+}
+
+cbor_status cbenc_bytestr_begin_sz(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  return_if_fail(cbenc_uint(ctx, sz));
+  ctx->mem[0] |= cbor_tbytestr;
+
+  return cs;
+}
+
+cbor_status cbenc_textstr_begin_sz(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  return_if_fail(cbenc_uint(ctx, sz));
+  ctx->mem[0] |= cbor_ttextstr;
+
+  return cs;
+}
+
+cbor_status cbenc_swrite(cbenc_ctx_t *ctx, const void *data, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint avail;
+  const uint8_t *p = (uint8_t*)data;
+
+  if(ctx->writev != NULL && sz >= CBOR_ENCODER_IOV_REF_SIZE && ctx->iovmax >= 3 &&
+     !encbuf_held(ctx)) {
+    return encbuf_ref(ctx, data, sz);
+  }
+
+  avail = encbuf_avail(ctx);
+
+  if(sz > avail && ctx->resize != NULL) {
+    return_if_fail(encbuf_resize(ctx, sz));
+    avail = encbuf_avail(ctx);
+  }
+
+  if(sz <= avail && (avail > 0 || ctx->resize != NULL)) {
+    cs = encbuf_grow(ctx, sz);
+    if(cs == cbor_ok) { memcpy(ctx->mem, p, sz); }
+    return cs;
+  }
+
+  return_if_fail(encbuf_flush(ctx));
+
+  if(encbuf_held(ctx)) {
+    // data of open containers can not bypass the buffer, it must fit next to them
+    return_if_fail(encbuf_grow(ctx, sz));
+    memcpy(ctx->mem, p, sz);
+    return cs;
+  }
+
+  return encbuf_write(ctx, p, sz);
+}
+
+cbor_status cbenc_sbypass(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  // measure mode holds no data, also inside open containers
+  if(cbenc_measuring(ctx)) {
+    ctx->size += sz;
+    return cs;
+  }
+
+  if(ctx->resize != NULL || ctx->opened > 0) { return cbor_eagain; }
+
+  return_if_fail(cbenc_end(ctx));
+  ctx->size += sz;
+
+  return cs;
+}
+
+cbor_status cbenc_array_begin(cbenc_ctx_t *ctx)
+{
+  return cbenc_header(ctx, cbor_tarray | st_varbrk, 0);
+}
+
+cbor_status cbenc_array(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  return_if_fail(cbenc_uint(ctx, sz));
+  ctx->mem[0] |= cbor_tarray;
+
+  return cs;
+}
+
+cbor_status cbenc_map_begin(cbenc_ctx_t *ctx)
+{
+  return cbenc_header(ctx, cbor_tmap | st_varbrk, 0);
+}
+
+cbor_status cbenc_map(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  return_if_fail(cbenc_uint(ctx, sz));
+  ctx->mem[0] |= cbor_tmap;
+
+  return cs;
+}
+
+/**
+ * Open container with the longest header, cbenc_close shrinks it
+*/
+static cbor_status cbenc_open(cbenc_ctx_t *ctx, uint8_t type, cbor_uint *mark)
+{
+  cbor_status cs = cbor_ok;
+  uint8_t st = (sizeof(cbor_uint) == 8)? st_size64 : (sizeof(cbor_uint) == 4)? st_size32 :
+               (sizeof(cbor_uint) == 2)? st_size16 : st_size8;
+
+  if(ctx->opened == CBOR_ENCODER_MAX_DEPTH) { return cbor_enomem; }
+
+  // buffer positions are output offsets only without listed segments
+  if(ctx->writev != NULL && !encbuf_held(ctx) && ctx->iovcnt > 0) {
+    return_if_fail(encbuf_flushv(ctx));
+  }
+
+  return_if_fail(cbenc_header(ctx, type | st, sizeof(cbor_uint)));
+
+  // absolute offset, the buffer may be flushed up to the outermost open container
+  *mark = ctx->size + (ctx->mem - ctx->buf);
+  ctx->marks[ctx->opened++] = *mark;
+
+  return cs;
+}
+
+cbor_status cbenc_array_open(cbenc_ctx_t *ctx, cbor_uint *mark)
+{
+  return cbenc_open(ctx, cbor_tarray, mark);
+}
+
+cbor_status cbenc_map_open(cbenc_ctx_t *ctx, cbor_uint *mark)
+{
+  return cbenc_open(ctx, cbor_tmap, mark);
+}
+
+cbor_status cbenc_close(cbenc_ctx_t *ctx, cbor_uint mark, cbor_uint count)
+{
+  uint8_t head[CBOR_ENCODER_MIN_BUFFER_SIZE], *p;
+  cbor_uint n, shift;
+
+  if(ctx->opened == 0 || ctx->marks[ctx->opened - 1] != mark) { return cbor_efmt; }
+
+  if(!cbenc_measuring(ctx)) {
+    // header is in the buffer: write the shortest one and move the content
+    p = ctx->buf + (mark - ctx->size);
+    n = enc_head(head, p[0] & 0xE0, count) - head;
+    shift = 1 + sizeof(cbor_uint) - n;
+
+    memmove(p + n, p + n + shift, ctx->end - (p + n + shift));
+    memcpy(p, head, n);
+    ctx->end -= shift;
+  }
+  else {
+    // measure mode has counted the header already
+    ctx->size -= 1 + sizeof(cbor_uint) - (enc_head(head, 0, count) - head);
+  }
+
+  ctx->opened--;
+
+  return cbor_ok;
+}
+
+cbor_status cbenc_break(cbenc_ctx_t *ctx)
+{
+  return cbenc_header(ctx, cbor_tsimple | st_varbrk, 0);
+}
+
+cbor_status cbenc_tag(cbenc_ctx_t *ctx, cbor_uint tag)
+{
+  cbor_status cs = cbor_ok;
+
+  return_if_fail(cbenc_uint(ctx, tag));
+  ctx->mem[0] |= cbor_ttag;
+
+  return cs;
+}
+
+#ifdef CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+cbor_status cbenc_typed_array(cbenc_ctx_t *ctx, cbor_tag tag, const void *data, cbor_uint count)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint n, size = typed_size(tag);
+  const uint8_t *p = (const uint8_t*)data;
+  uint8_t tmp[16];
+
+  if(size == 0 || count > CBOR_UINT_MAX / size) { return cbor_efmt; }
+
+  return_if_fail(cbenc_tag(ctx, tag));
+  return_if_fail(cbenc_bytestr_begin_sz(ctx, count * size));
+
+  if(count == 0) { return cs; }
+  // measure mode only counts the data
+  if(!typed_swap(tag) || cbenc_measuring(ctx)) { return cbenc_swrite(ctx, data, count * size); }
+
+  while(count) {
+    n = encbuf_avail(ctx) / size;
+
+    if(n == 0) {
+      if(ctx->bufsz < size && ctx->resize == NULL) {
+        // the buffer can not hold a single element
+        bswap_array(tmp, p, 1, size);
+        return_if_fail(cbenc_swrite(ctx, tmp, size));
+        p += size;
+        count--;
+        continue;
+      }
+
+      return_if_fail(encbuf_room(ctx, size));
+      n = encbuf_avail(ctx) / size;
+      if(n == 0) { return cbor_enomem; }
+    }
+
+    if(n > count) { n = count; }
+
+    // swap straight into the buffer
+    return_if_fail(encbuf_grow(ctx, n * size));
+    bswap_array(ctx->mem, p, n, size);
+
+    p += n * size;
+    count -= n;
+  }
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+#endif // CBOR_ENABLE_ENCODER_SUPPORT
+
+
+#ifdef CBOR_ENABLE_DECODER_SUPPORT
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+
+/**
+ * Check that data is well-formed UTF-8 (RFC 3629), scalar version
+ *
+ * @param  p - ptr to data
+ * @param  n - data size
+ * @return non-zero if valid
+*/
+static int utf8_valid_scalar(const uint8_t *p, size_t n)
+{
+  const uint8_t *end = p + n;
+  uint8_t c, lo, hi;
+  size_t len, i;
+
+  while(p < end) {
+    if(end - p >= 8 && (load64(p) & 0x8080808080808080ull) == 0) { p += 8; continue; }
+
+    c = *p;
+    if(c < 0x80) { p++; continue; }
+    if(c < 0xC2 || c > 0xF4) { return 0; }
+
+    // the second byte range excludes overlong forms, surrogates and code points above U+10FFFF
+    len = utf8_seqlen(c);
+    lo  = (c == 0xE0)? 0xA0 : (c == 0xF0)? 0x90 : 0x80;
+    hi  = (c == 0xED)? 0x9F : (c == 0xF4)? 0x8F : 0xBF;
+
+    if((size_t)(end - p) < len || p[1] < lo || p[1] > hi) { return 0; }
+    for(i = 2; i < len; i++) {
+      if((p[i] & 0xC0) != 0x80) { return 0; }
+    }
+
+    p += len;
+  }
+
+  return 1;
+}
+
+#ifdef CBOR_X86_SIMD
+
+/**
+ * Vectorised validation after John Keiser and Daniel Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte". Every byte is classified by the high nibble of the previous byte, the low
+ * nibble of the previous byte and its own high nibble, a non-zero AND of the three classes is an
+ * error, except for continuation bytes expected after 3 and 4 byte lead bytes.
+*/
+enum utf8_error
+{
+  ue_too_short  = 1 << 0, // 11______ 0_______ or 11______ 11______
+  ue_too_long   = 1 << 1, // 0_______ 10______
+  ue_overlong_3 = 1 << 2, // 11100000 100_____
+  ue_too_large  = 1 << 3, // 11110100 1001____ and above
+  ue_surrogate  = 1 << 4, // 11101101 101_____
+  ue_overlong_2 = 1 << 5, // 1100000_ 10______
+  ue_large_1000 = 1 << 6, // 11110101 1000____ and above
+  ue_overlong_4 = 1 << 6, // 11110000 1000____
+  ue_two_conts  = 1 << 7, // 10______ 10______
+  ue_carry      = ue_too_short | ue_too_long | ue_two_conts
+};
+
+static const uint8_t utf8_prev_high[16] =
+{
+  ue_too_long, ue_too_long, ue_too_long, ue_too_long,
+  ue_too_long, ue_too_long, ue_too_long, ue_too_long,
+  ue_two_conts, ue_two_conts, ue_two_conts, ue_two_conts,
+  ue_too_short | ue_overlong_2,
+  ue_too_short,
+  ue_too_short | ue_overlong_3 | ue_surrogate,
+  ue_too_short | ue_too_large | ue_large_1000 | ue_overlong_4
+};
+
+static const uint8_t utf8_prev_low[16] =
+{
+  ue_carry | ue_overlong_3 | ue_overlong_2 | ue_overlong_4,
+  ue_carry | ue_overlong_2,
+  ue_carry,
+  ue_carry,
+  ue_carry | ue_too_large,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000 | ue_surrogate,
+  ue_carry | ue_too_large | ue_large_1000,
+  ue_carry | ue_too_large | ue_large_1000
+};
+
+static const uint8_t utf8_cur_high[16] =
+{
+  ue_too_short, ue_too_short, ue_too_short, ue_too_short,
+  ue_too_short, ue_too_short, ue_too_short, ue_too_short,
+  ue_too_long | ue_overlong_2 | ue_two_conts | ue_overlong_3 | ue_large_1000 | ue_overlong_4,
+  ue_too_long | ue_overlong_2 | ue_two_conts | ue_overlong_3 | ue_too_large,
+  ue_too_long | ue_overlong_2 | ue_two_conts | ue_surrogate  | ue_too_large,
+  ue_too_long | ue_overlong_2 | ue_two_conts | ue_surrogate  | ue_too_large,
+  ue_too_short, ue_too_short, ue_too_short, ue_too_short
+};
+
+// limits for the last three bytes of a block, a greater byte starts an incomplete sequence
+static const uint8_t utf8_incomplete[32] =
+{
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF
+};
+
+CBOR_TARGET("sse4.1")
+static int utf8_valid_sse(const uint8_t *p, size_t n)
+{
+  const __m128i prev_high = _mm_loadu_si128((const __m128i*)utf8_prev_high);
+  const __m128i prev_low  = _mm_loadu_si128((const __m128i*)utf8_prev_low);
+  const __m128i cur_high  = _mm_loadu_si128((const __m128i*)utf8_cur_high);
+  const __m128i limit     = _mm_loadu_si128((const __m128i*)(utf8_incomplete + 16));
+  const __m128i nibble    = _mm_set1_epi8(0x0F);
+  __m128i in, prev = _mm_setzero_si128(), err = prev, incomplete = prev;
+  __m128i prev1, cls, must;
+  uint8_t tail[16];
+  size_t i;
+
+  for(i = 0; i < n; i += 16) {
+    if(n - i >= 16) {
+      in = _mm_loadu_si128((const __m128i*)(p + i));
+    }
+    else {
+      // zero padding is ASCII, it terminates an incomplete sequence with an error
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, p + i, n - i);
+      in = _mm_loadu_si128((const __m128i*)tail);
+    }
+
+    if(_mm_movemask_epi8(in) == 0) {
+      err = _mm_or_si128(err, incomplete);
+    }
+    else {
+      prev1 = _mm_alignr_epi8(in, prev, 15);
+      cls = _mm_shuffle_epi8(prev_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+      cls = _mm_and_si128(cls, _mm_shuffle_epi8(prev_low, _mm_and_si128(prev1, nibble)));
+      cls = _mm_and_si128(cls,
+              _mm_shuffle_epi8(cur_high, _mm_and_si128(_mm_srli_epi16(in, 4), nibble)));
+
+      // continuation bytes 2 and 3 positions after 111_____ and 1111____ lead bytes
+      must = _mm_or_si128(_mm_subs_epu8(_mm_alignr_epi8(in, prev, 14), _mm_set1_epi8(0xE0 - 0x80)),
+                          _mm_subs_epu8(_mm_alignr_epi8(in, prev, 13), _mm_set1_epi8(0xF0 - 0x80)));
+      must = _mm_and_si128(must, _mm_set1_epi8((char)0x80));
+
+      err = _mm_or_si128(err, _mm_xor_si128(must, cls));
+      incomplete = _mm_subs_epu8(in, limit);
+    }
+
+    prev = in;
+  }
+
+  err = _mm_or_si128(err, incomplete);
+  return _mm_testz_si128(err, err);
+}
+
+CBOR_TARGET("avx2")
+static int utf8_valid_avx2(const uint8_t *p, size_t n)
+{
+  // the same 16 entry table in both lanes
+  const __m256i prev_high =
+    _mm256_broadcastsi128_si256(_mm_loadu_si128((const void*)utf8_prev_high));
+  const __m256i prev_low  =
+    _mm256_broadcastsi128_si256(_mm_loadu_si128((const void*)utf8_prev_low));
+  const __m256i cur_high  =
+    _mm256_broadcastsi128_si256(_mm_loadu_si128((const void*)utf8_cur_high));
+  const __m256i limit     = _mm256_loadu_si256((const __m256i*)utf8_incomplete);
+  const __m256i nibble    = _mm256_set1_epi8(0x0F);
+  __m256i in, prev = _mm256_setzero_si256(), err = prev, incomplete = prev;
+  __m256i cross, prev1, cls, must;
+  uint8_t tail[32];
+  size_t i;
+
+  for(i = 0; i < n; i += 32) {
+    if(n - i >= 32) {
+      in = _mm256_loadu_si256((const __m256i*)(p + i));
+    }
+    else {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, p + i, n - i);
+      in = _mm256_loadu_si256((const __m256i*)tail);
+    }
+
+    if(_mm256_movemask_epi8(in) == 0) {
+      err = _mm256_or_si256(err, incomplete);
+    }
+    else {
+      // alignr works within 128-bit lanes, so shift in the high lane of the previous block
+      cross = _mm256_permute2x128_si256(prev, in, 0x21);
+      prev1 = _mm256_alignr_epi8(in, cross, 15);
+      cls = _mm256_shuffle_epi8(prev_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+      cls = _mm256_and_si256(cls, _mm256_shuffle_epi8(prev_low, _mm256_and_si256(prev1, nibble)));
+      cls = _mm256_and_si256(cls,
+              _mm256_shuffle_epi8(cur_high, _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+
+      must = _mm256_or_si256(
+               _mm256_subs_epu8(_mm256_alignr_epi8(in, cross, 14), _mm256_set1_epi8(0xE0 - 0x80)),
+               _mm256_subs_epu8(_mm256_alignr_epi8(in, cross, 13), _mm256_set1_epi8(0xF0 - 0x80)));
+      must = _mm256_and_si256(must, _mm256_set1_epi8((char)0x80));
+
+      err = _mm256_or_si256(err, _mm256_xor_si256(must, cls));
+      incomplete = _mm256_subs_epu8(in, limit);
+    }
+
+    prev = in;
+  }
+
+  err = _mm256_or_si256(err, incomplete);
+  return _mm256_testz_si256(err, err);
+}
+
+#endif // CBOR_X86_SIMD
+
+/**
+ * Check that data is well-formed UTF-8
+ *
+ * @param  p - ptr to data
+ * @param  n - data size
+ * @return non-zero if valid
+*/
+static int utf8_valid(const uint8_t *p, size_t n)
+{
+#ifdef CBOR_X86_SIMD
+  if(n >= 32 && __builtin_cpu_supports("avx2")) { return utf8_valid_avx2(p, n); }
+  if(n >= 16 && __builtin_cpu_supports("sse4.1")) { return utf8_valid_sse(p, n); }
+#endif
+
+  return utf8_valid_scalar(p, n);
+}
+
+#endif // CBOR_ENABLE_UTF8_SUPPORT
+
+static inline int decbuf_is_mem(const cbdec_ctx_t *ctx)
+{
+  return ctx->read == 0 && ctx->fill == 0 && ctx->iov == 0;
+}
+
+/**
+ * Go to the next non-empty segment, if the current one is exhausted
+*/
+static cbor_status decbuf_next(cbdec_ctx_t *ctx)
+{
+  while(ctx->pos == ctx->end) {
+    if(ctx->iovcnt == 0) { return cbor_eos; }
+
+    ctx->pos = (const uint8_t*)ctx->iov->base;
+    ctx->end = ctx->pos + ctx->iov->len;
+    ctx->iov++;
+    ctx->iovcnt--;
+  }
+
+  return cbor_ok;
+}
+
+/**
+ * Move unread bytes to the beginning of read-ahead buffer and fill it up to at least sz bytes
+*/
+static cbor_status decbuf_refill(cbdec_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint n, len = ctx->end - ctx->pos;
+
+  if(len > 0) { memmove(ctx->rabuf, ctx->pos, len); }
+  ctx->pos = ctx->rabuf;
+  ctx->end = ctx->rabuf + len;
+
+  while(len < sz) {
+    n = ctx->rabufsz - len;
+    return_if_fail(ctx->fill(ctx->rabuf + len, &n, ctx->usrdata));
+    if(n == 0) { return cbor_eos; }
+
+    len += n;
+    ctx->end += n;
+  }
+
+  return cs;
+}
+
+static cbor_status decbuf_underflow(cbdec_ctx_t *ctx, cbor_uint sz, const uint8_t **p)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint n, len;
+
+  if(ctx->fill) {
+    return_if_fail(decbuf_refill(ctx, sz));
+    *p = ctx->pos;
+    ctx->pos += sz;
+    return cs;
+  }
+
+  if(ctx->iov) {
+    len = ctx->end - ctx->pos;
+
+    if(len == 0) {
+      return_if_fail(decbuf_next(ctx));
+      if((size_t)(ctx->end - ctx->pos) >= sz) {
+        *p = ctx->pos;
+        ctx->pos += sz;
+        return cs;
+      }
+      len = ctx->end - ctx->pos;
+    }
+
+    // header is split between segments
+    memcpy(ctx->buf, ctx->pos, len);
+    ctx->pos = ctx->end;
+
+    while(len < sz) {
+      return_if_fail(decbuf_next(ctx));
+      n = ctx->end - ctx->pos;
+      if(n > sz - len) { n = sz - len; }
+
+      memcpy(ctx->buf + len, ctx->pos, n);
+      ctx->pos += n;
+      len += n;
+    }
+
+    *p = ctx->buf;
+    return cs;
+  }
+
+  if(ctx->read == 0) { return cbor_eos; }
+
+  *p = ctx->buf;
+  return ctx->read(ctx->buf, sz, ctx->usrdata);
+}
+
+static cbor_status decbuf_copy_underflow(cbdec_ctx_t *ctx, void *data, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint n, len;
+  uint8_t *p = (uint8_t*)data;
+
+  if(ctx->fill) {
+    len = ctx->end - ctx->pos;
+    if(len > 0) { memcpy(p, ctx->pos, len); }
+    ctx->pos = ctx->end;
+    p  += len;
+    sz -= len;
+
+    if(sz < ctx->rabufsz) {
+      return_if_fail(decbuf_refill(ctx, sz));
+      memcpy(p, ctx->pos, sz);
+      ctx->pos += sz;
+      return cs;
+    }
+
+    // large read, bypass the buffer
+    while(sz) {
+      n = sz;
+      return_if_fail(ctx->fill(p, &n, ctx->usrdata));
+      if(n == 0) { return cbor_eos; }
+
+      p  += n;
+      sz -= n;
+    }
+
+    return cs;
+  }
+
+  if(ctx->iov) {
+    while(sz) {
+      return_if_fail(decbuf_next(ctx));
+      n = ctx->end - ctx->pos;
+      if(n > sz) { n = sz; }
+
+      memcpy(p, ctx->pos, n);
+      ctx->pos += n;
+      p  += n;
+      sz -= n;
+    }
+
+    return cs;
+  }
+
+  if(ctx->read == 0) { return cbor_eos; }
+
+  return ctx->read(data, sz, ctx->usrdata);
+}
+
+/**
+ * Take sz bytes from the memory window or, if the window is exhausted, from the data source
+ *
+ * @param  ctx - decoder context
+ * @param  sz  - number of bytes (must not be greater than sizeof(ctx->buf))
+ * @param  p   - ptr to the bytes
+ * @return status code
+*/
+static inline cbor_status decbuf_fetch(cbdec_ctx_t *ctx, cbor_uint sz, const uint8_t **p)
+{
+  if((size_t)(ctx->end - ctx->pos) >= sz) {
+    *p = ctx->pos;
+    ctx->pos += sz;
+    return cbor_ok;
+  }
+
+  return decbuf_underflow(ctx, sz, p);
+}
+
+static inline cbor_status decbuf_copy(cbdec_ctx_t *ctx, void *data, cbor_uint sz)
+{
+  if((size_t)(ctx->end - ctx->pos) >= sz) {
+    memcpy(data, ctx->pos, sz);
+    ctx->pos += sz;
+    return cbor_ok;
+  }
+
+  return decbuf_copy_underflow(ctx, data, sz);
+}
+
+enum dec_kind
+{
+  dk_none,   // value is the argument
+  dk_neg,    // negative integer
+  dk_half,   // half float
+  dk_simple  // simple value
+};
+
+struct dec_item
+{
+  uint8_t token; // cbor_token
+  uint8_t size;  // argument size in bytes following the initial byte
+  uint8_t kind;  // enum dec_kind
+  uint8_t imm;   // value, if argument size is zero
+};
+
+#define DT_INV                {cbor_tinvalid, 0, dk_none, 0}
+#define DT_IMM(t, k, v)       {t, 0, k, v}
+#define DT_ARG(t, k, n)       {t, n, k, 0}
+#define DT_IMM4(t, k, v)      DT_IMM(t, k, v), DT_IMM(t, k, v + 1), DT_IMM(t, k, v + 2), \
+                              DT_IMM(t, k, v + 3)
+#define DT_IMM8(t, k, v)      DT_IMM4(t, k, v), DT_IMM4(t, k, v + 4)
+#define DT_INV4               DT_INV, DT_INV, DT_INV, DT_INV
+
+#ifdef CBOR_INTTYPE_16
+  #define DT_ARG16(t, k)      DT_ARG(t, k, 2)
+#else
+  #define DT_ARG16(t, k)      DT_INV
+#endif
+
+#ifdef CBOR_INTTYPE_32
+  #define DT_ARG32(t, k)      DT_ARG(t, k, 4)
+#else
+  #define DT_ARG32(t, k)      DT_INV
+#endif
+
+#ifdef CBOR_INTTYPE_64
+  #define DT_ARG64(t, k)      DT_ARG(t, k, 8)
+#else
+  #define DT_ARG64(t, k)      DT_INV
+#endif
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+  #define DT_HALF             DT_ARG(cbor_tfloat32, dk_half, 2)
+  #define DT_FLOAT32          DT_ARG(cbor_tfloat32, dk_none, 4)
+#else
+  #define DT_HALF             DT_INV
+  #define DT_FLOAT32          DT_INV
+#endif
+
+#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
+  #define DT_FLOAT64          DT_ARG(cbor_tfloat64, dk_none, 8)
+#else
+  #define DT_FLOAT64          DT_INV
+#endif
+
+#define DT_MAJOR(t, k, var)   DT_IMM8(t, k, 0), DT_IMM8(t, k, 8), DT_IMM8(t, k, 16), \
+                              DT_ARG(t, k, 1), DT_ARG16(t, k), DT_ARG32(t, k), DT_ARG64(t, k), \
+                              DT_INV, DT_INV, DT_INV, var
+
+// decoding of every initial byte
+static const struct dec_item dec_table[256] =
+{
+  DT_MAJOR(cbor_tuint,    dk_none, DT_INV),
+  DT_MAJOR(cbor_tint,     dk_neg,  DT_INV),
+  DT_MAJOR(cbor_tbytestr, dk_none, DT_IMM(cbor_tvbytestr, dk_none, 0)),
+  DT_MAJOR(cbor_ttextstr, dk_none, DT_IMM(cbor_tvtextstr, dk_none, 0)),
+  DT_MAJOR(cbor_tarray,   dk_none, DT_IMM(cbor_tvarray,   dk_none, 0)),
+  DT_MAJOR(cbor_tmap,     dk_none, DT_IMM(cbor_tvmap,     dk_none, 0)),
+  DT_MAJOR(cbor_ttag,     dk_none, DT_INV),
+
+  // simple values and floats
+  DT_INV4, DT_INV4, DT_INV4, DT_INV4, DT_INV4,
+  DT_IMM4(cbor_tsimple, dk_simple, cbor_false),
+  DT_INV, DT_HALF, DT_FLOAT32, DT_FLOAT64, DT_INV, DT_INV, DT_INV,
+  DT_IMM(cbor_tbreak, dk_none, 0)
+};
+
+static inline cbor_uint dec_arg(const uint8_t *p, uint8_t size)
+{
+  switch(size) {
+  case 1: return p[0];
+
+#ifdef CBOR_INTTYPE_16
+  case 2: return cbor_bswap16(load16(p));
+#endif
+
+#ifdef CBOR_INTTYPE_32
+  case 4: return cbor_bswap32(load32(p));
+#endif
+
+#ifdef CBOR_INTTYPE_64
+  case 8: return cbor_bswap64(load64(p));
+#endif
+
+  default: return 0;
+  }
+}
+
+/**
+ * Decode the argument of item at p, the longest header (9 bytes) must be readable
+*/
+static inline cbor_uint dec_inplace(const uint8_t *p, const struct dec_item *item)
+{
+#ifdef CBOR_INTTYPE_64
+  return item->size? cbor_bswap64(load64(p + 1)) >> (64 - 8 * item->size) : item->imm;
+#else
+  return item->size? dec_arg(p + 1, item->size) : item->imm;
+#endif
+}
+
+cbor_status cbdec_step(cbdec_ctx_t *ctx)
+{
+  cbor_status cs = cbor_ok;
+  const struct dec_item *item;
+  const uint8_t *p = ctx->pos;
+  cbor_uint val;
+
+  if((size_t)(ctx->end - p) >= 9) {
+    // the longest header is in the window, decode it in place
+    item = &dec_table[p[0]];
+    val  = dec_inplace(p, item);
+    ctx->pos = p + 1 + item->size;
+  }
+  else {
+    return_if_fail(decbuf_fetch(ctx, 1, &p));
+    item = &dec_table[p[0]];
+    val  = item->imm;
+
+    if(item->size) {
+      return_if_fail(decbuf_fetch(ctx, item->size, &p));
+      val = dec_arg(p, item->size);
+    }
+  }
+
+  ctx->token = item->token;
+  ctx->utf8len = 0;
+
+  switch(item->kind) {
+  case dk_neg:
+    ctx->value.u = ~val;
+    break;
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+  case dk_half:
+    ctx->value.u = decode_float16(val);
+    break;
+#endif
+
+  case dk_simple:
+    ctx->value.st = val;
+    break;
+
+  default:
+    ctx->value.u = val;
+    break;
+  }
+
+  return (ctx->token == cbor_tinvalid)? cbor_efmt : cs;
+}
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+
+/**
+ * Validate the next piece of text string data
+ *
+ * @param  ctx - decoder context (ctx->value.u is the string length left after the piece)
+ * @param  p   - ptr to the piece
+ * @param  n   - piece size
+ * @return status code
+ *
+ * @brief  A character split between pieces is carried over in the context and checked once
+ *         complete. Each chunk of a variable length string is validated on its own.
+*/
+static cbor_status dec_utf8(cbdec_ctx_t *ctx, const uint8_t *p, size_t n)
+{
+  size_t len, k, i;
+
+  if(ctx->utf8len) {
+    len = utf8_seqlen(ctx->utf8tmp[0]);
+    k = len - ctx->utf8len;
+    if(k > n) { k = n; }
+
+    memcpy(ctx->utf8tmp + ctx->utf8len, p, k);
+    ctx->utf8len += k;
+    p += k;
+    n -= k;
+
+    if(ctx->utf8len < len) { return (ctx->value.u)? cbor_ok : cbor_efmt; }
+    if(!utf8_valid_scalar(ctx->utf8tmp, len)) { return cbor_efmt; }
+
+    ctx->utf8len = 0;
+  }
+
+  if(ctx->value.u) {
+    // look for a lead byte of an incomplete character at the end of the piece
+    for(i = 1; i <= 3 && i <= n; i++) {
+      if(p[n - i] < 0x80) { break; }
+      if(p[n - i] < 0xC0) { continue; }
+
+      if(utf8_seqlen(p[n - i]) > i) {
+        n -= i;
+        memcpy(ctx->utf8tmp, p + n, i);
+        ctx->utf8len = i;
+      }
+      break;
+    }
+  }
+
+  return utf8_valid(p, n)? cbor_ok : cbor_efmt;
+}
+
+#endif // CBOR_ENABLE_UTF8_SUPPORT
+
+cbor_status cbdec_sread(cbdec_ctx_t *ctx, void *data, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint n;
+
+  n = (sz > ctx->value.u)? ctx->value.u : sz;
+  if(n == 0) { return cbor_ok; }
+
+  return_if_fail(decbuf_copy(ctx, data, n));
+  ctx->value.u -= n;
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+  if(ctx->utf8 && ctx->token == cbor_ttextstr) { return dec_utf8(ctx, (const uint8_t*)data, n); }
+#endif
+
+  return cs;
+}
+
+/**
+ * Take the next piece of string data, see cbdec_sview
+*/
+static cbor_status decbuf_view(cbdec_ctx_t *ctx, const void **data, cbor_uint *sz)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint n = ctx->value.u;
+  size_t len = ctx->end - ctx->pos;
+
+  if(decbuf_is_mem(ctx)) {
+    if(len < n) { return cbor_eos; }
+  }
+  else
+  if(len == 0 && n > 0) {
+    if(ctx->fill) {
+      return_if_fail(decbuf_refill(ctx, 1));
+      len = ctx->end - ctx->pos;
+    }
+    else
+    if(ctx->iov) {
+      return_if_fail(decbuf_next(ctx));
+      len = ctx->end - ctx->pos;
+    }
+    else {
+      if(n > sizeof(ctx->buf)) { n = sizeof(ctx->buf); }
+      return_if_fail(ctx->read(ctx->buf, n, ctx->usrdata));
+
+      *data = ctx->buf;
+      *sz = n;
+      ctx->value.u -= n;
+      return cs;
+    }
+  }
+
+  if(n > len) { n = len; }
+
+  *data = ctx->pos;
+  *sz = n;
+  ctx->pos += n;
+  ctx->value.u -= n;
+
+  return cs;
+}
+
+cbor_status cbdec_sview(cbdec_ctx_t *ctx, const void **data, cbor_uint *sz)
+{
+  cbor_status cs = cbor_ok;
+
+  return_if_fail(decbuf_view(ctx, data, sz));
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+  if(ctx->utf8 && ctx->token == cbor_ttextstr) { return dec_utf8(ctx, (const uint8_t*)*data, *sz); }
+#endif
+
+  return cs;
+}
+
+cbor_status cbdec_sbypass(cbdec_ctx_t *ctx, cbor_uint sz)
+{
+  cbor_status cs = cbor_ok;
+
+  if(sz > ctx->value.u) { return cbor_efmt; }
+
+  // data in decoder memory is taken with cbdec_sview
+  if(decbuf_is_mem(ctx) || ctx->iov != NULL || ctx->pos < ctx->end) { return cbor_eagain; }
+
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+  if(ctx->utf8 && ctx->token == cbor_ttextstr) { return cbor_eagain; }
+#endif
+
+  ctx->value.u -= sz;
+
+  return cs;
+}
+
+enum dec_array_kind
+{
+  da_uint,
+  da_int,
+  da_float32,
+  da_float64
+};
+
+/**
+ * Store item to array element, if the item type suits the array
+ *
+ * @return non-zero if stored
+*/
+static inline int dec_array_put(cbor_token token, cbor_value value, enum dec_array_kind kind,
+                                void *vals, cbor_uint i)
+{
+  switch(kind) {
+  case da_uint:
+    if(token != cbor_tuint) { return 0; }
+    ((cbor_uint*)vals)[i] = value.u;
+    return 1;
+
+  case da_int:
+    // the value must not overflow cbor_int
+    if(token == cbor_tuint && value.s < 0) { return 0; }
+    if(token == cbor_tint && value.s >= 0) { return 0; }
+    if(token != cbor_tuint && token != cbor_tint) { return 0; }
+    ((cbor_int*)vals)[i] = value.s;
+    return 1;
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+  case da_float32:
+    switch(token) {
+    case cbor_tuint:    ((float*)vals)[i] = (float)value.u; return 1;
+    case cbor_tint:     ((float*)vals)[i] = (float)value.s; return 1;
+    case cbor_tfloat32: ((float*)vals)[i] = value.f32; return 1;
+    default: return 0;
+    }
+#endif
+
+#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
+  case da_float64:
+    switch(token) {
+    case cbor_tuint:    ((double*)vals)[i] = (double)value.u; return 1;
+    case cbor_tint:     ((double*)vals)[i] = (double)value.s; return 1;
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+    case cbor_tfloat32: ((double*)vals)[i] = value.f32; return 1;
+#endif
+    case cbor_tfloat64: ((double*)vals)[i] = value.f64; return 1;
+    default: return 0;
+    }
+#endif
+
+  default: return 0;
+  }
+}
+
+static inline cbor_status dec_array(cbdec_ctx_t *ctx, void *vals, cbor_uint count, cbor_uint *n,
+                                    enum dec_array_kind kind)
+{
+  cbor_status cs = cbor_ok;
+  const struct dec_item *item;
+  cbor_value value;
+  cbor_uint i;
+
+  for(i = 0; i < count; i++) {
+    if((size_t)(ctx->end - ctx->pos) >= 9) {
+      // numbers in the window are decoded in place
+      item = &dec_table[ctx->pos[0]];
+
+      if(item->kind != dk_simple) {
+        value.u = dec_inplace(ctx->pos, item);
+        if(item->kind == dk_neg) { value.u = ~value.u; }
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+        if(item->kind == dk_half) { value.u = decode_float16((uint16_t)value.u); }
+#endif
+
+        if(dec_array_put((cbor_token)item->token, value, kind, vals, i)) {
+          ctx->pos  += 1 + item->size;
+          ctx->token = (cbor_token)item->token;
+          ctx->value = value;
+          continue;
+        }
+      }
+    }
+
+    if((cs = cbdec_step(ctx)) != cbor_ok) { break; }
+
+    if(!dec_array_put(ctx->token, ctx->value, kind, vals, i)) {
+      cs = (ctx->token == cbor_tbreak)? cbor_ok : cbor_efmt;
+      break;
+    }
+  }
+
+  *n = i;
+  return cs;
+}
+
+cbor_status cbdec_uint_array(cbdec_ctx_t *ctx, cbor_uint *vals, cbor_uint count, cbor_uint *n)
+{
+  return dec_array(ctx, vals, count, n, da_uint);
+}
+
+cbor_status cbdec_int_array(cbdec_ctx_t *ctx, cbor_int *vals, cbor_uint count, cbor_uint *n)
+{
+  return dec_array(ctx, vals, count, n, da_int);
+}
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+
+cbor_status cbdec_float32_array(cbdec_ctx_t *ctx, float *vals, cbor_uint count, cbor_uint *n)
+{
+  return dec_array(ctx, vals, count, n, da_float32);
+}
+
+#endif // CBOR_ENABLE_FLOAT32_SUPPORT
+
+#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
+
+cbor_status cbdec_float64_array(cbdec_ctx_t *ctx, double *vals, cbor_uint count, cbor_uint *n)
+{
+  return dec_array(ctx, vals, count, n, da_float64);
+}
+
+#endif // CBOR_ENABLE_FLOAT64_SUPPORT
+
+#ifdef CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+cbor_status cbdec_typed_array(cbdec_ctx_t *ctx, cbor_uint tag, void *data, cbor_uint count)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint n, size = typed_size(tag);
+
+  if(size == 0 || ctx->token != cbor_tbytestr || ctx->value.u % size) { return cbor_efmt; }
+
+  n = ctx->value.u / size;
+  if(n > count) { n = count; }
+  if(n == 0) { return cs; }
+
+  return_if_fail(cbdec_sread(ctx, data, n * size));
+  if(typed_swap(tag)) { bswap_array(data, data, n, size); }
+
+  return cs;
+}
+
+#endif // CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+/**
+ * Skip the rest of the current string
+ *
+ * @brief Read callback decoder views data by 8 bytes, so its data is read in larger parts.
+*/
+static cbor_status decbuf_discard(cbdec_ctx_t *ctx)
+{
+  cbor_status cs = cbor_ok;
+  uint8_t tmp[256];
+  const void *data;
+  cbor_uint n;
+
+  while(ctx->value.u) {
+    if(ctx->read != NULL) {
+      n = (ctx->value.u > sizeof(tmp))? sizeof(tmp) : ctx->value.u;
+      return_if_fail(ctx->read(tmp, n, ctx->usrdata));
+      ctx->value.u -= n;
+    }
+    else {
+      return_if_fail(decbuf_view(ctx, &data, &n));
+    }
+  }
+
+  return cs;
+}
+
+cbor_status cbdec_skip(cbdec_ctx_t *ctx)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint left = 0, n = 0; // number of items left on the current level
+  uint8_t var = 0; // the level has variable length
+  unsigned depth = 0; // levels saved on the context stack
+
+  if(ctx->token == cbor_tbreak) { return cbor_ok; }
+
+  for(;;) {
+    switch(ctx->token) {
+    case cbor_tbytestr:
+    case cbor_ttextstr:
+      return_if_fail(decbuf_discard(ctx));
+      break;
+
+    case cbor_tmap:
+      if(ctx->value.u > (CBOR_UINT_MAX - 1) / 2) { return cbor_efmt; }
+      n = ctx->value.u * 2;
+      break;
+
+    case cbor_tarray:
+      n = ctx->value.u;
+      break;
+
+    case cbor_ttag:
+      n = 1;
+      break;
+
+    case cbor_tvbytestr:
+    case cbor_tvtextstr:
+    case cbor_tvarray:
+    case cbor_tvmap:
+      if(depth == CBOR_DECODER_MAX_DEPTH) { return cbor_enomem; }
+      ctx->varlen[depth] = var;
+      ctx->stack[depth++] = left;
+      left = 1;
+      var  = 1;
+      break;
+
+    case cbor_tbreak:
+      if(!var) { return cbor_efmt; }
+      left = ctx->stack[--depth];
+      var  = ctx->varlen[depth];
+      break;
+
+    case cbor_tinvalid:
+      return cbor_efmt;
+
+    default: break;
+    }
+
+    if(n > 0) {
+      // definite length container
+      if(var) {
+        if(depth == CBOR_DECODER_MAX_DEPTH) { return cbor_enomem; }
+        ctx->varlen[depth] = var;
+        ctx->stack[depth++] = left;
+        left = n;
+        var  = 0;
+      }
+      else {
+        if(n >= CBOR_UINT_MAX - left) { return cbor_efmt; }
+        left += n;
+      }
+      n = 0;
+    }
+
+    while(left == 0 && depth > 0) {
+      left = ctx->stack[--depth];
+      var  = ctx->varlen[depth];
+    }
+    if(left == 0) { break; }
 
-  return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size32, 4));
-  *(uint32_t*)(&ctx->mem[1]) = cbor_bswap32(v.u);
+    return_if_fail(cbdec_step(ctx));
+    if(!var) { left--; }
+  }
 
   return cs;
 }
 
-#endif // CBOR_ENABLE_FLOAT32_SUPPORT
-
-#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
-
-cbor_status cbenc_float64(cbenc_ctx_t *ctx, double val)
+/**
+ * Get sz bytes of the current string in place, without consuming them
+ *
+ * @return status code (cbor_enomem, if the data can't be made contiguous)
+*/
+static cbor_status decbuf_peek(cbdec_ctx_t *ctx, cbor_uint sz, const uint8_t **p)
 {
   cbor_status cs = cbor_ok;
-  union { double f; uint64_t u; } v = { val };
 
-  if(v.u == 0) { return cbenc_uint(ctx, 0); }
+  if((size_t)(ctx->end - ctx->pos) < sz) {
+    if(decbuf_is_mem(ctx)) { return cbor_eos; }
+    if(ctx->fill == 0 || sz > ctx->rabufsz) { return cbor_enomem; }
+    return_if_fail(decbuf_refill(ctx, sz));
+  }
 
-  return_if_fail(cbenc_header(ctx, cbor_tsimple | st_size64, 8));
-  *(uint64_t*)(&ctx->mem[1]) = cbor_bswap64(v.u);
+  *p = ctx->pos;
 
   return cs;
 }
 
-#endif // CBOR_ENABLE_FLOAT64_SUPPORT
-
-cbor_status cbenc_simple(cbenc_ctx_t *ctx, cbor_simple val)
+static uint32_t key_hash(const uint8_t *p, cbor_uint sz)
 {
-  return cbenc_header(ctx, cbor_tsimple | val, 0);
-}
+  uint32_t h = 2166136261u; // FNV-1a
 
-cbor_status cbenc_bytestr_begin(cbenc_ctx_t *ctx)
-{
-  return cbenc_header(ctx, cbor_tbytestr | st_varbrk, 0);
-}
+  while(sz--) { h = (h ^ *p++) * 16777619u; }
 
-cbor_status cbenc_bytestr(cbenc_ctx_t *ctx, const void *data, cbor_uint sz)
-{
-  return cbenc_bytes(ctx, cbor_tbytestr, data, sz);
+  return h;
 }
 
-cbor_status cbenc_textstr_begin(cbenc_ctx_t *ctx)
+/**
+ * Compare current text string with keys that are not found yet
+ *
+ * @return status code, res is set to the matching key or to null
+*/
+static cbor_status map_key_match(cbdec_ctx_t *ctx, cbdec_key_t *keys, size_t n, cbdec_key_t **res)
 {
-  return cbenc_header(ctx, cbor_ttextstr | st_varbrk, 0);
-}
+  cbor_status cs = cbor_ok;
+  cbor_uint len = ctx->value.u, off, sz;
+  size_t i, cnt = 0;
+  const uint8_t *p;
+  const void *data;
+  uint32_t h = 0;
 
-#ifdef CBOR_ENABLE_UTF8_SUPPORT
+  *res = 0;
 
-static const char *utf8_truncate(const uint8_t *s, cbor_uint char_limit)
-{
-  cbor_uint i, n;
-  const uint8_t *end = s;
+  for(i = 0; i < n; i++) {
+    if(keys[i].token == cbor_tinvalid && keys[i].len == len) { cnt++; *res = &keys[i]; }
+  }
 
-#ifndef CBOR_INTTYPE_64
-  cbor_uint byte_limit = CBOR_UINT_MAX;
-#endif
+  if(cnt == 0) { return cbdec_skip(ctx); }
 
-  while(*s && char_limit--) {
-    n = 1;
-    if(*s > 127) {
-      if     ((*s & 0xE0) == 0xC0) { n += 1; }
-      else if((*s & 0xF0) == 0xE0) { n += 2; }
-      else if((*s & 0xF8) == 0xF0) { n += 3; }
-      else if((*s & 0xFC) == 0xF8) { n += 4; }
-      else if((*s & 0xFE) == 0xFC) { n += 5; }
-      else                         { break;  }
-    }
+  cs = decbuf_peek(ctx, len, &p);
 
-#ifndef CBOR_INTTYPE_64
-    if(byte_limit < n) { break; }
-    byte_limit -= n;
-#endif
+  if(cs == cbor_ok) {
+    if(cnt > 1) { h = key_hash(p, len); }
 
-    for(i = 1; i < n; i++) {
-      if((s[i] & 0xC0) != 0x80) { return (char*)end; }
+    ctx->pos += len;
+    ctx->value.u = 0;
+
+    if(cnt == 1) {
+      if(len && memcmp(p, (*res)->key, len) != 0) { *res = 0; }
+      return cs;
     }
 
-    s += n; end = s;
+    for(i = 0; i < n; i++) {
+      if(keys[i].token == cbor_tinvalid && keys[i].len == len && keys[i].hash == h &&
+         (len == 0 || memcmp(p, keys[i].key, len) == 0)) { *res = &keys[i]; return cs; }
+    }
+
+    *res = 0;
+    return cs;
   }
 
-  return (char*)end;
-}
+  if(cs != cbor_enomem) { return cs; }
 
-#endif // CBOR_ENABLE_UTF8_SUPPORT
+  // the key is not contiguous in memory, compare it piece by piece
+  for(i = 0; i < n; i++) { keys[i].match = (keys[i].token == cbor_tinvalid && keys[i].len == len); }
 
-cbor_status cbenc_textstr(cbenc_ctx_t *ctx, const char *data, cbor_uint sz)
-{
-#ifdef CBOR_ENABLE_UTF8_SUPPORT
-  const char *end = utf8_truncate((uint8_t*)data, sz);
-  return cbenc_bytes(ctx, cbor_ttextstr, data, end - data);
-#else
-  return cbenc_bytes(ctx, cbor_ttextstr, data, sz);
-#endif
-}
+  for(off = 0; ctx->value.u; off += sz) {
+    return_if_fail(decbuf_view(ctx, &data, &sz));
 
-cbor_status cbenc_cstring(cbenc_ctx_t *ctx, const char *data)
-{
-  cbor_status cs = cbor_ok;
+    for(i = 0; i < n; i++) {
+      if(keys[i].match && memcmp(data, keys[i].key + off, sz) != 0) { keys[i].match = 0; }
+    }
+  }
 
-#ifdef CBOR_ENABLE_UTF8_SUPPORT
-  const char *end = utf8_truncate((uint8_t*)data, CBOR_UINT_MAX);
-  if(*end == 0) { return cbenc_bytes(ctx, cbor_ttextstr, data, end - data); }
+  *res = 0;
 
-  return_if_fail(cbenc_header(ctx, cbor_ttextstr | st_varbrk, 0));
+  for(i = 0; i < n && *res == 0; i++) {
+    if(keys[i].match) { *res = &keys[i]; }
+  }
 
-  do {
-    return_if_fail(cbenc_bytes(ctx, cbor_ttextstr, data, end - data));
-    data = end;
-    end  = utf8_truncate((uint8_t*)data, CBOR_UINT_MAX);
-  } while(*end);
+  return cbor_ok;
+}
 
-  if(end > data) { return_if_fail(cbenc_bytes(ctx, cbor_ttextstr, data, end - data)); }
+cbor_status cbdec_map_find(cbdec_ctx_t *ctx, const char *key, cbor_uint keylen)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint left = ctx->value.u;
+  cbor_token type = ctx->token;
+  cbdec_key_t k, *res = 0;
 
-  return cbenc_break(ctx);
-#else
-  size_t len, n;
+  if(type != cbor_tmap && type != cbor_tvmap) { return cbor_efmt; }
 
-  len = strlen(data);
+  k.key   = key;
+  k.len   = keylen;
+  k.token = cbor_tinvalid;
 
-  if(len > CBOR_UINT_MAX) {
-    return_if_fail(cbenc_header(ctx, cbor_ttextstr | st_varbrk, 0));
+  while(type == cbor_tvmap || left--) {
+    return_if_fail(cbdec_step(ctx));
+    if(ctx->token == cbor_tbreak) { return (type == cbor_tvmap)? cbor_eos : cbor_efmt; }
 
-    while(len) {
-      n = (len > CBOR_UINT_MAX)? CBOR_UINT_MAX : len;
-      return_if_fail(cbenc_bytes(ctx, cbor_ttextstr, data, n));
-      len -= n; data += n;
+    if(ctx->token == cbor_ttextstr && ctx->value.u == keylen) {
+      return_if_fail(map_key_match(ctx, &k, 1, &res));
+    }
+    else {
+      return_if_fail(cbdec_skip(ctx));
     }
 
-    return cbenc_break(ctx);
+    // break in place of the value: odd number of items
+    return_if_fail(cbdec_step(ctx));
+    if(ctx->token == cbor_tbreak) { return cbor_efmt; }
+    if(res) { return cs; }
+
+    return_if_fail(cbdec_skip(ctx));
   }
 
-  return cbenc_bytes(ctx, cbor_ttextstr, data, len);
-#endif
+  return cbor_eos;
 }
 
-cbor_status cbenc_bytestr_begin_sz(cbenc_ctx_t *ctx, cbor_uint sz)
+void cbdec_map_keys_init(cbdec_key_t *keys, size_t n)
 {
-  cbor_status cs = cbor_ok;
-
-  return_if_fail(cbenc_uint(ctx, sz));
-  ctx->mem[0] |= cbor_tbytestr;
-
-  return cs;
+  while(n--) {
+    keys->hash = key_hash((const uint8_t*)keys->key, keys->len);
+    keys++;
+  }
 }
 
-cbor_status cbenc_textstr_begin_sz(cbenc_ctx_t *ctx, cbor_uint sz)
+cbor_status cbdec_map_keys(cbdec_ctx_t *ctx, cbdec_key_t *keys, size_t n)
 {
   cbor_status cs = cbor_ok;
+  cbor_uint left = ctx->value.u;
+  cbor_token type = ctx->token;
+  cbdec_key_t *res;
+  const uint8_t *start;
+  size_t i, found = 0;
+  int mem = decbuf_is_mem(ctx);
+
+  if(type != cbor_tmap && type != cbor_tvmap) { return cbor_efmt; }
+
+  for(i = 0; i < n; i++) {
+    keys[i].token = cbor_tinvalid;
+    keys[i].data  = 0;
+    keys[i].sz    = 0;
+  }
 
-  return_if_fail(cbenc_uint(ctx, sz));
-  ctx->mem[0] |= cbor_ttextstr;
+  while(type == cbor_tvmap || left--) {
+    return_if_fail(cbdec_step(ctx));
+    if(ctx->token == cbor_tbreak) {
+      if(type == cbor_tvmap) { break; }
+      return cbor_efmt;
+    }
 
-  return cs;
-}
+    res = 0;
 
-cbor_status cbenc_swrite(cbenc_ctx_t *ctx, const void *data, cbor_uint sz)
-{
-  cbor_status cs = cbor_ok;
-  cbor_uint avail;
-  const uint8_t *p = (uint8_t*)data;
+    if(ctx->token == cbor_ttextstr && found < n) {
+      return_if_fail(map_key_match(ctx, keys, n, &res));
+    }
+    else {
+      return_if_fail(cbdec_skip(ctx));
+    }
 
-  avail = encbuf_avail(ctx);
+    start = ctx->pos;
+    return_if_fail(cbdec_step(ctx));
+    if(ctx->token == cbor_tbreak) { return cbor_efmt; }
 
-  if(avail > 0 && sz <= avail) {
-    cs = encbuf_grow(ctx, sz);
-    if(cs == cbor_ok) { memcpy(ctx->mem, p, sz); }
-    return cs;
-  }
+    if(res) {
+      res->token = ctx->token;
+      res->value = ctx->value;
+      found++;
+    }
 
-  if(encbuf_datalen(ctx) > 0) {
-    // flush buffer
-    return_if_fail(ctx->write(ctx->buf, encbuf_datalen(ctx), ctx->usrdata));
-    ctx->end = ctx->buf;
-  }
+    return_if_fail(cbdec_skip(ctx));
 
-  return ctx->write(p, sz, ctx->usrdata);
-}
+    if(res && mem) {
+      res->data = start;
+      res->sz   = ctx->pos - start;
+    }
+  }
 
-cbor_status cbenc_array_begin(cbenc_ctx_t *ctx)
-{
-  return cbenc_header(ctx, cbor_tarray | st_varbrk, 0);
+  return cs;
 }
 
-cbor_status cbenc_array(cbenc_ctx_t *ctx, cbor_uint sz)
+cbor_status cbdec_schunk(cbdec_ctx_t *ctx, const void **data, cbor_uint *sz)
 {
   cbor_status cs = cbor_ok;
+  cbor_token type = ctx->token & ~1;
 
-  return_if_fail(cbenc_uint(ctx, sz));
-  ctx->mem[0] |= cbor_tarray;
+  if(type != cbor_tbytestr && type != cbor_ttextstr) { return cbor_efmt; }
 
-  return cs;
+  // decoders with read callback or read-ahead buffer view the chunk in pieces
+  if(ctx->token == type && ctx->value.u > 0) { return cbdec_sview(ctx, data, sz); }
+
+  return_if_fail(cbdec_step(ctx));
+
+  if(ctx->token == cbor_tbreak) { *sz = 0; return cs; }
+  if(ctx->token != type) { return cbor_efmt; }
+
+  return cbdec_sview(ctx, data, sz);
 }
 
-cbor_status cbenc_map_begin(cbenc_ctx_t *ctx)
+struct val_level
 {
-  return cbenc_header(ctx, cbor_tmap | st_varbrk, 0);
-}
+  cbor_uint left; // number of items left, not zero for variable length container
+  uint8_t   kind; // token of variable length container, cbor_tinvalid for fixed length
+  uint8_t   odd;  // odd number of items in variable length map
+};
 
-cbor_status cbenc_map(cbenc_ctx_t *ctx, cbor_uint sz)
+cbor_status cbdec_validate(const void *data, size_t sz, unsigned flags)
 {
-  cbor_status cs = cbor_ok;
+  const uint8_t *p = (const uint8_t*)data, *end = p + sz;
+  const struct dec_item *item;
+  struct val_level cur, stack[CBOR_DECODER_MAX_DEPTH];
+  unsigned depth;
+  cbor_uint val, n;
 
-  return_if_fail(cbenc_uint(ctx, sz));
-  ctx->mem[0] |= cbor_tmap;
+  if(sz == 0) { return (flags & CBOR_VALIDATE_SEQUENCE)? cbor_ok : cbor_eos; }
 
-  return cs;
-}
+  do {
+    cur.left = 1;
+    cur.kind = cbor_tinvalid;
+    cur.odd  = 0;
+    depth = 0;
+
+    while(cur.left) {
+      if(p == end) { return cbor_eos; }
+
+      item = &dec_table[p[0]];
+      val  = item->imm;
+
+      if(item->size) {
+        if((size_t)(end - p) <= item->size) { return cbor_eos; }
+        val = (end - p >= 9)? dec_inplace(p, item) : dec_arg(p + 1, item->size);
+      }
+
+      p += 1 + item->size;
+      n = 0;
+
+      if(cur.kind == cbor_tinvalid) {
+        cur.left--;
+      }
+      else
+      if(item->token != cbor_tbreak) {
+        // item of variable length container
+        if(cur.kind == cbor_tvmap) { cur.odd ^= 1; }
+        else
+        if(cur.kind != cbor_tvarray && item->token != (cur.kind & ~1)) { return cbor_efmt; }
+      }
+
+      switch(item->token) {
+      case cbor_ttextstr:
+      case cbor_tbytestr:
+        if(val > (cbor_uint)(end - p)) { return cbor_eos; }
 
-cbor_status cbenc_break(cbenc_ctx_t *ctx)
-{
-  return cbenc_header(ctx, cbor_tsimple | st_varbrk, 0);
+#ifdef CBOR_ENABLE_UTF8_SUPPORT
+        if((flags & CBOR_VALIDATE_UTF8) && item->token == cbor_ttextstr && !utf8_valid(p, val)) {
+          return cbor_efmt;
+        }
+#endif
+
+        p += val;
+        break;
+
+      case cbor_tmap:
+        if(val > (CBOR_UINT_MAX - 1) / 2) { return cbor_efmt; }
+        n = val * 2;
+        break;
+
+      case cbor_tarray:
+        n = val;
+        break;
+
+      case cbor_ttag:
+        n = 1;
+        break;
+
+      case cbor_tvbytestr:
+      case cbor_tvtextstr:
+      case cbor_tvarray:
+      case cbor_tvmap:
+        if(depth == CBOR_DECODER_MAX_DEPTH) { return cbor_enomem; }
+        stack[depth++] = cur;
+        cur.left = 1;
+        cur.kind = item->token;
+        cur.odd  = 0;
+        break;
+
+      case cbor_tbreak:
+        if(cur.kind == cbor_tinvalid || cur.odd) { return cbor_efmt; }
+        cur = stack[--depth];
+        break;
+
+      case cbor_tinvalid:
+        return cbor_efmt;
+
+      default: break;
+      }
+
+      if(n > 0) {
+        // definite length container
+        if(cur.kind != cbor_tinvalid) {
+          if(depth == CBOR_DECODER_MAX_DEPTH) { return cbor_enomem; }
+          stack[depth++] = cur;
+          cur.left = n;
+          cur.kind = cbor_tinvalid;
+          cur.odd  = 0;
+        }
+        else {
+          if(n >= CBOR_UINT_MAX - cur.left) { return cbor_efmt; }
+          cur.left += n;
+        }
+      }
+
+      while(cur.left == 0 && depth > 0) { cur = stack[--depth]; }
+    }
+  } while((flags & CBOR_VALIDATE_SEQUENCE) && p < end);
+
+  return (p == end)? cbor_ok : cbor_efmt;
 }
 
-cbor_status cbenc_tag(cbenc_ctx_t *ctx, cbor_uint tag)
+static cbor_status push_decode(cbpush_ctx_t *ctx, const uint8_t *p, cbor_uint sz, cbor_uint *used)
 {
   cbor_status cs = cbor_ok;
+  cbdec_ctx_t dec = CBOR_DECODER_MEM_CTX_INITIALIZER(p, sz);
 
-  return_if_fail(cbenc_uint(ctx, tag));
-  ctx->mem[0] |= cbor_ttag;
+  return_if_fail(cbdec_step(&dec));
+
+  ctx->token = dec.token;
+  ctx->value = dec.value;
+  *used = dec.pos - p;
 
   return cs;
 }
 
-#endif // CBOR_ENABLE_ENCODER_SUPPORT
-
-
-#ifdef CBOR_ENABLE_DECODER_SUPPORT
-
-static cbor_status cbdec_uint(cbdec_ctx_t *ctx, uint8_t s_type)
+cbor_status cbpush_step(cbpush_ctx_t *ctx, const void *data, cbor_uint sz, cbor_uint *used)
 {
   cbor_status cs = cbor_ok;
+  const uint8_t *p = (const uint8_t*)data;
+  cbor_uint n = 0, k;
 
-  if(s_type < 24) { ctx->value.u = s_type; return cbor_ok; }
+  *used = 0;
 
-  switch(s_type) {
-  case st_size8:
-    return_if_fail(ctx->read(ctx->buf, 1, ctx->usrdata));
-    ctx->value.u = *(uint8_t*)(ctx->buf);
-    break;
+  if(ctx->token == cbor_tbytestr || ctx->token == cbor_ttextstr) {
+    if(cbpush_sview(ctx, sz, used) == cbor_eagain) { return cbor_eagain; }
+    p  += *used;
+    sz -= *used;
+  }
 
-#ifdef CBOR_INTTYPE_16
-  case st_size16:
-    return_if_fail(ctx->read(ctx->buf, 2, ctx->usrdata));
-    ctx->value.u = cbor_bswap16(*(uint16_t*)(ctx->buf));
-    break;
-#endif
+  if(ctx->have == 0) {
+    cs = push_decode(ctx, p, sz, &n);
+    if(cs != cbor_eos) { *used += n; return cs; }
+  }
 
-#ifdef CBOR_INTTYPE_32
-  case st_size32:
-    return_if_fail(ctx->read(ctx->buf, 4, ctx->usrdata));
-    ctx->value.u = cbor_bswap32(*(uint32_t*)(ctx->buf));
-    break;
-#endif
+  // header is split between fragments
+  k = sizeof(ctx->hdr) - ctx->have;
+  if(k > sz) { k = sz; }
 
-#ifdef CBOR_INTTYPE_64
-  case st_size64:
-    return_if_fail(ctx->read(ctx->buf, 8, ctx->usrdata));
-    ctx->value.u = cbor_bswap64(*(uint64_t*)(ctx->buf));
-    break;
-#endif
+  if(k) { memcpy(ctx->hdr + ctx->have, p, k); }
 
-  default: return cbor_efmt;
+  cs = push_decode(ctx, ctx->hdr, ctx->have + k, &n);
+
+  if(cs == cbor_eos) {
+    ctx->have += k;
+    *used += k;
+    return cbor_eagain;
   }
 
+  *used += n - ctx->have;
+  ctx->have = 0;
+
   return cs;
 }
 
-static inline cbor_status cbdec_int(cbdec_ctx_t *ctx, uint8_t s_type)
+cbor_status cbpush_sview(cbpush_ctx_t *ctx, cbor_uint sz, cbor_uint *used)
 {
-  cbor_status cs = cbor_ok;
-
-  return_if_fail(cbdec_uint(ctx, s_type));
-  ctx->value.s = -(ctx->value.s + 1);
+  *used = (sz > ctx->value.u)? ctx->value.u : sz;
+  ctx->value.u -= *used;
 
-  return cs;
+  return (ctx->value.u > 0)? cbor_eagain : cbor_ok;
 }
 
-#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+#ifdef CBOR_ENABLE_TAPE_SUPPORT
 
-/**
- * Convert float16 to float32
- *
- * @param  h - float16 bits
- * @return float32 bits
- *
- * @link   https://github.com/numpy/numpy
- * @copyright
- *   Copyright (c) 2005-2017, NumPy Developers.
- *   All rights reserved.
- *
- *   Redistribution and use in source and binary forms, with or without
- *   modification, are permitted provided that the following conditions are
- *   met:
- *
- *       * Redistributions of source code must retain the above copyright
- *          notice, this list of conditions and the following disclaimer.
- *
- *       * Redistributions in binary form must reproduce the above
- *          copyright notice, this list of conditions and the following
- *          disclaimer in the documentation and/or other materials provided
- *          with the distribution.
- *
- *       * Neither the name of the NumPy Developers nor the names of any
- *          contributors may be used to endorse or promote products derived
- *          from this software without specific prior written permission.
- *
- *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
- *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
- *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
- *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
- *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
- *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
- *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
- *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
- *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
- *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
- *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-*/
-static uint32_t decode_float16(uint16_t h)
+cbor_status cbtape_parse(cbtape_t *tape, const void *data, cbor_uint sz)
 {
-  uint16_t h_exp, h_sig;
-  uint32_t f_sgn, f_exp, f_sig;
+  cbor_status cs = cbor_ok;
+  cbdec_ctx_t ctx = CBOR_DECODER_MEM_CTX_INITIALIZER(data, sz);
+  struct { size_t idx; cbor_uint left; } stack[CBOR_TAPE_MAX_DEPTH], *top = 0;
+  unsigned depth = 0;
+  const uint8_t *start;
+  cbtape_item_t *item;
+  cbor_uint n;
 
-  h_exp = (h & 0x7C00u);
-  f_sgn = ((uint32_t)h & 0x8000u) << 16;
-  switch(h_exp) {
-  case 0x0000u: /* 0 or subnormal */
-    h_sig = (h & 0x03FFu);
-    /* Signed zero */
-    if(h_sig == 0) { return f_sgn; }
-    /* Subnormal */
-    h_sig <<= 1;
-    while((h_sig & 0x0400u) == 0) {
-      h_sig <<= 1;
-      h_exp++;
-    }
-    f_exp = ((uint32_t)(127 - 15 - h_exp)) << 23;
-    f_sig = ((uint32_t)(h_sig & 0x03FFu)) << 13;
-    return f_sgn + f_exp + f_sig;
+  tape->data  = (const uint8_t*)data;
+  tape->count = 0;
 
-  case 0x7C00u: /* inf or NaN */
-    /* All-ones exponent and a copy of the significand */
-    return f_sgn + 0x7F800000u + (((uint32_t)(h & 0x03FFu)) << 13);
+  for(;;) {
+    start = ctx.pos;
+    cs = cbdec_step(&ctx);
+    if(cs == cbor_eos && depth == 0 && start == ctx.end) { return cbor_ok; }
+    if(cs != cbor_ok) { return cs; }
 
-  default: /* normalized */
-    /* Just need to adjust the exponent and shift */
-    return f_sgn + (((uint32_t)(h & 0x7FFFu) + 0x1C000u) << 13);
-  }
-}
+    if(ctx.token == cbor_tbreak) {
+      if(depth == 0) { return cbor_efmt; }
 
-static cbor_status cbdec_float(cbdec_ctx_t *ctx, uint8_t s_type)
-{
-  cbor_status cs = cbor_ok;
+      item = &tape->items[top->idx];
+      if(!(item->token & 1)) { return cbor_efmt; }
 
-  if(s_type == st_size16) {
-    return_if_fail(ctx->read(ctx->buf, 2, ctx->usrdata));
-    ctx->value.u = decode_float16( cbor_bswap16(*(uint16_t*)(ctx->buf)) );
-    return cbor_ok;
-  }
+      if(item->token == cbor_tvmap) {
+        if(top->left & 1) { return cbor_efmt; }
+        top->left /= 2;
+      }
 
-  if(s_type == st_size32) {
-    return_if_fail(ctx->read(ctx->buf, 4, ctx->usrdata));
-    ctx->value.u = cbor_bswap32(*(uint32_t*)(ctx->buf));
-    return cbor_ok;
+      item->value.u = top->left;
+      item->next = tape->count;
+      top = (--depth > 0)? &stack[depth - 1] : 0;
+    }
+    else {
+      if(tape->count == tape->size) { return cbor_enomem; }
+
+      if(depth > 0) {
+        item = &tape->items[top->idx];
+
+        if(item->token & 1) {
+          top->left++;
+          if((item->token == cbor_tvbytestr || item->token == cbor_tvtextstr) &&
+             ctx.token != (item->token & ~1)) { return cbor_efmt; }
+        }
+        else {
+          top->left--;
+        }
+      }
+
+      item = &tape->items[tape->count];
+      item->offset  = start - tape->data;
+      item->next    = ++tape->count;
+      item->token   = ctx.token;
+      item->value.u = ctx.value.u;
+
+      switch(ctx.token) {
+      case cbor_tbytestr:
+      case cbor_ttextstr:
+        return_if_fail(cbdec_skip(&ctx));
+        n = 0;
+        break;
+
+      case cbor_tmap:
+        if(ctx.value.u > CBOR_UINT_MAX / 2) { return cbor_efmt; }
+        n = ctx.value.u * 2;
+        break;
+
+      case cbor_tarray:
+        if(ctx.value.u == CBOR_UINT_MAX) { return cbor_efmt; }  // reserved for variable length
+        n = ctx.value.u;
+        break;
+
+      case cbor_ttag:
+        n = 1;
+        break;
+
+      case cbor_tvbytestr:
+      case cbor_tvtextstr:
+      case cbor_tvarray:
+      case cbor_tvmap:
+        item->value.u = 0;
+        n = CBOR_UINT_MAX;
+        break;
+
+      default:
+        n = 0;
+        break;
+      }
+
+      if(n > 0) {
+        if(depth == CBOR_TAPE_MAX_DEPTH) { return cbor_enomem; }
+
+        top = &stack[depth++];
+        top->idx  = tape->count - 1;
+        top->left = (n == CBOR_UINT_MAX)? 0 : n;
+        continue;
+      }
+    }
+
+    // close finished containers with fixed length
+    while(depth > 0 && !(tape->items[top->idx].token & 1) && top->left == 0) {
+      tape->items[top->idx].next = tape->count;
+      top = (--depth > 0)? &stack[depth - 1] : 0;
+    }
   }
 
-  return cbor_efmt;
+  return cs;
 }
 
-#endif // CBOR_ENABLE_FLOAT32_SUPPORT
-
-#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
-
-static cbor_status cbdec_float64(cbdec_ctx_t *ctx)
+cbor_status cbtape_at(const cbtape_t *tape, size_t idx, cbor_uint n, size_t *res)
 {
-  cbor_status cs = cbor_ok;
+  const cbtape_item_t *item;
+  cbor_uint cnt;
 
-  return_if_fail(ctx->read(ctx->buf, 8, ctx->usrdata));
-  ctx->value.u = cbor_bswap64(*(uint64_t*)(ctx->buf));
+  if(idx >= tape->count) { return cbor_efmt; }
 
-  return cs;
-}
+  item = &tape->items[idx];
 
-#endif // CBOR_ENABLE_FLOAT64_SUPPORT
+  switch(item->token) {
+  case cbor_tvbytestr:
+  case cbor_tvtextstr:
+  case cbor_tarray:
+  case cbor_tvarray: cnt = item->value.u;     break;
+  case cbor_tmap:
+  case cbor_tvmap:   cnt = item->value.u * 2; break;
+  case cbor_ttag:    cnt = 1;                 break;
+  default: return cbor_efmt;
+  }
 
-cbor_status cbdec_step(cbdec_ctx_t *ctx)
-{
-  cbor_status cs = cbor_ok;
-  uint8_t s_type;
+  if(n >= cnt) { return cbor_eos; }
 
-  return_if_fail(ctx->read(ctx->buf, 1, ctx->usrdata));
+  idx++;
 
-  ctx->token = ctx->buf[0] & 0xE0;
-  s_type     = ctx->buf[0] & 0x1F;
+  // all elements are single items
+  if(item->next - idx == cnt) { *res = idx + n; return cbor_ok; }
 
-  if(ctx->token == cbor_tsimple) {
-    switch(s_type) {
-#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
-    case st_size16:
-    case st_size32:
-      ctx->token = cbor_tfloat32;
-      return cbdec_float(ctx, s_type);
-#else
-    case st_size16:
-    case st_size32:
-      return cbor_efmt;
-#endif
+  while(n--) { idx = tape->items[idx].next; }
+  *res = idx;
 
-#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
-    case st_size64:
-      ctx->token = cbor_tfloat64;
-      return cbdec_float64(ctx);
-#else
-    case st_size64:
-      return cbor_efmt;
-#endif
+  return cbor_ok;
+}
 
-    case st_varbrk:
-      ctx->token = cbor_tbreak;
-      return cbor_ok;
+cbor_status cbtape_find(const cbtape_t *tape, size_t idx, const char *key, cbor_uint keylen,
+                        size_t *res)
+{
+  const cbtape_item_t *item;
+  const void *data;
+  cbor_uint i, sz;
 
-    case cbor_false:
-    case cbor_true:
-    case cbor_null:
-    case cbor_undef:
-      ctx->value.st = s_type;
-      return cbor_ok;
-    }
-  }
-  else
-  if(s_type == st_varbrk && ctx->token >= cbor_tbytestr && ctx->token <= cbor_tmap) {
-    ctx->token |= 1; return cbor_ok;
-  }
+  if(idx >= tape->count) { return cbor_efmt; }
 
-  switch(ctx->token) {
-    case cbor_tuint:
-    case cbor_ttag:
-    case cbor_tbytestr:
-    case cbor_ttextstr:
-    case cbor_tarray:
-    case cbor_tmap:
-      return cbdec_uint(ctx, s_type);
+  item = &tape->items[idx];
+  if(item->token != cbor_tmap && item->token != cbor_tvmap) { return cbor_efmt; }
 
-    case cbor_tint:
-      return cbdec_int(ctx, s_type);
+  idx++;
 
-    default:
-      ctx->token = cbor_tinvalid;
-      break;
+  for(i = 0; i < item->value.u; i++) {
+    if(tape->items[idx].token == cbor_ttextstr && tape->items[idx].value.u == keylen) {
+      if(cbtape_sview(tape, idx, &data, &sz) == cbor_ok && memcmp(data, key, sz) == 0) {
+        *res = tape->items[idx].next;
+        return cbor_ok;
+      }
+    }
+
+    idx = tape->items[tape->items[idx].next].next;
   }
 
-  return cbor_efmt;
+  return cbor_eos;
 }
 
-cbor_status cbdec_sread(cbdec_ctx_t *ctx, void *data, cbor_uint sz)
+cbor_status cbtape_sview(const cbtape_t *tape, size_t idx, const void **data, cbor_uint *sz)
 {
-  cbor_status cs = cbor_ok;
-  cbor_uint n;
+  static const uint8_t hdrlen[] = {2, 3, 5, 9};
+  const cbtape_item_t *item;
+  const uint8_t *p;
 
-  n = (sz > ctx->value.u)? ctx->value.u : sz;
-  if(n == 0) { return cbor_ok; }
+  if(idx >= tape->count) { return cbor_efmt; }
 
-  return_if_fail(ctx->read(data, n, ctx->usrdata));
-  ctx->value.u -= n;
+  item = &tape->items[idx];
+  if(item->token != cbor_tbytestr && item->token != cbor_ttextstr) { return cbor_efmt; }
 
-  return cs;
+  p = tape->data + item->offset;
+  *data = p + (((p[0] & 0x1F) < 24)? 1 : hdrlen[(p[0] & 0x1F) - 24]);
+  *sz = item->value.u;
+
+  return cbor_ok;
 }
 
+#endif // CBOR_ENABLE_TAPE_SUPPORT
+
 #endif // CBOR_ENABLE_DECODER_SUPPORT
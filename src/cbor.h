@@ -44,19 +44,64 @@
 #define CBOR_ENABLE_FLOAT32_SUPPORT
 #define CBOR_ENABLE_FLOAT64_SUPPORT
 
+/**
+ * Encode float zero (+0.0) as uint 0
+ *
+ * @note Saves 2 bytes, but the value is decoded as integer.
+*/
+//#define CBOR_ENABLE_FLOAT_ZERO_AS_UINT
+
 /**
  * Enable UTF-8 support
 */
 #define CBOR_ENABLE_UTF8_SUPPORT
 
+/**
+ * Enable SIMD code paths
+ *
+ * @note x86 with GCC or Clang only, SSE4.1 or AVX2 version is selected at run time. Scalar code
+ *       is used on other targets and CPUs.
+*/
+#define CBOR_ENABLE_SIMD_SUPPORT
+
+/**
+ * Enable typed arrays support (RFC 8746)
+*/
+#define CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+/**
+ * Decoder container stack depth
+ *
+ * @note Used by cbdec_skip and cbdec_validate to track nesting of containers with variable length.
+*/
+#define CBOR_DECODER_MAX_DEPTH 16
+
+/**
+ * Enable tape index support (requires decoder)
+*/
+#define CBOR_ENABLE_TAPE_SUPPORT
+
+/**
+ * Tape index container stack depth
+*/
+#define CBOR_TAPE_MAX_DEPTH 32
+
 // -------------------------------------------------------------------------------------------------
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if defined(_MSC_VER) && !defined(__cplusplus)
+  #define CBOR_INLINE static __inline
+#else
+  #define CBOR_INLINE static inline
+#endif
+
 #ifdef CBOR_ENABLE_FLOAT32_SUPPORT
   #define CBOR_INTTYPE_32
 #endif
@@ -100,9 +145,17 @@ typedef enum
   cbor_ok,
   cbor_eos,  // end of stream
   cbor_efmt, // format error
-  cbor_eio   // I/O error
+  cbor_eio,  // I/O error
+  cbor_enomem, // not enough memory
+  cbor_eagain  // need more data
 } cbor_status;
 
+typedef struct cbor_iovec
+{
+  const void *base; // ptr to segment data
+  size_t len; // segment size
+} cbor_iovec_t; // data segment, layout compatible with POSIX struct iovec
+
 // Registered CBOR tags from: https://www.iana.org/assignments/cbor-tags/cbor-tags.xhtml
 typedef enum
 {
@@ -136,6 +189,29 @@ typedef enum
   cbor_tag_langtag        = 38,      // language-tagged string
   cbor_tag_identifier     = 39,      // identifier
   cbor_tag_cwt            = 61,      // CBOR Web Token (CWT)
+  cbor_tag_ta_u8          = 64,      // typed array of uint8
+  cbor_tag_ta_u16be       = 65,      // typed array of uint16, big endian
+  cbor_tag_ta_u32be       = 66,      // typed array of uint32, big endian
+  cbor_tag_ta_u64be       = 67,      // typed array of uint64, big endian
+  cbor_tag_ta_u8_clamped  = 68,      // typed array of uint8, clamped arithmetic
+  cbor_tag_ta_u16le       = 69,      // typed array of uint16, little endian
+  cbor_tag_ta_u32le       = 70,      // typed array of uint32, little endian
+  cbor_tag_ta_u64le       = 71,      // typed array of uint64, little endian
+  cbor_tag_ta_s8          = 72,      // typed array of int8
+  cbor_tag_ta_s16be       = 73,      // typed array of int16, big endian
+  cbor_tag_ta_s32be       = 74,      // typed array of int32, big endian
+  cbor_tag_ta_s64be       = 75,      // typed array of int64, big endian
+  cbor_tag_ta_s16le       = 77,      // typed array of int16, little endian
+  cbor_tag_ta_s32le       = 78,      // typed array of int32, little endian
+  cbor_tag_ta_s64le       = 79,      // typed array of int64, little endian
+  cbor_tag_ta_f16be       = 80,      // typed array of float16, big endian
+  cbor_tag_ta_f32be       = 81,      // typed array of float32, big endian
+  cbor_tag_ta_f64be       = 82,      // typed array of float64, big endian
+  cbor_tag_ta_f128be      = 83,      // typed array of float128, big endian
+  cbor_tag_ta_f16le       = 84,      // typed array of float16, little endian
+  cbor_tag_ta_f32le       = 85,      // typed array of float32, little endian
+  cbor_tag_ta_f64le       = 86,      // typed array of float64, little endian
+  cbor_tag_ta_f128le      = 87,      // typed array of float128, little endian
   cbor_tag_cose_encrypt   = 96,      // COSE Encrypted Data Object
   cbor_tag_cose_mac       = 97,      // COSE MACed Data Object
   cbor_tag_cose_sign      = 98,      // COSE Signed Data Object
@@ -186,9 +262,29 @@ typedef enum
   cbor_tinvalid                       // invalid token
 } cbor_token;
 
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+
+/**
+ * Convert float values to half float (IEEE 754 binary16) bits and back
+ *
+ * @param  dst   - ptr to converted values
+ * @param  src   - ptr to values
+ * @param  count - number of values
+ *
+ * @brief  Rounds to nearest even, NaN is made quiet. Uses F16C where available, with results
+ *         equal to the portable code. Half floats of typed arrays (cbor_tag_ta_f16le,
+ *         cbor_tag_ta_f16be) are converted with these.
+ */
+void cbor_float16_encode(uint16_t *dst, const float *src, cbor_uint count);
+void cbor_float16_decode(float *dst, const uint16_t *src, cbor_uint count);
+
+#endif
+
 #ifdef CBOR_ENABLE_ENCODER_SUPPORT
 
 #define CBOR_ENCODER_MIN_BUFFER_SIZE 9
+#define CBOR_ENCODER_IOV_REF_SIZE 128 // min data size that vectored output references, not copies
+#define CBOR_ENCODER_MAX_DEPTH 16 // max nesting of containers opened by cbenc_array_open
 
 typedef struct cbenc_ctx
 {
@@ -197,10 +293,21 @@ typedef struct cbenc_ctx
   uint8_t *buf; // pointer to data buffer
   cbor_uint bufsz; // data buffer size (must not be less then: CBOR_ENCODER_MIN_BUFFER_SIZE)
   void *usrdata; // user data pointer
+  void *(*resize)(void *buf, cbor_uint sz, void *usrdata); // growable buffer resize callback
+  cbor_status (*writev)(const cbor_iovec_t *iov, size_t iovcnt, void *usrdata); // vectored write
+  cbor_iovec_t *iov; // segment list of vectored output
+  size_t iovmax; // segment list size (min 3 to reference data)
+  cbor_status (*sync)(void *usrdata); // called by cbenc_end after the last write (optional)
 
   // private:
   uint8_t *end;
   uint8_t *mem;
+  cbor_uint size;
+  cbor_uint opened;
+  size_t iovcnt;
+  uint8_t *seg;
+  uint8_t scratch[CBOR_ENCODER_MIN_BUFFER_SIZE];
+  cbor_uint marks[CBOR_ENCODER_MAX_DEPTH];
 } cbenc_ctx_t;
 
 /**
@@ -211,7 +318,51 @@ typedef struct cbenc_ctx
  * @param bufsz   - buffer size (min 9 bytes!)
  * @param usrdata - ptr to user data
 */
-#define CBOR_ENCODER_CTX_INITIALIZER(write, buf, bufsz, usrdata) {write, buf, bufsz, usrdata, 0, 0}
+#define CBOR_ENCODER_CTX_INITIALIZER(write, buf, bufsz, usrdata) \
+  {write, buf, bufsz, usrdata, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {0}, {0}}
+
+/**
+ * Initializer for encoder context with growable memory buffer
+ *
+ * @param resize  - buffer resize callback, same as realloc: called with NULL buf for the first
+ *                  allocation, returns NULL on failure
+ * @param reserve - initial buffer size
+ * @param usrdata - ptr to user data
+ *
+ * @note Data is encoded into one contiguous buffer, cbenc_end does not write it anywhere. Take
+ *       the buffer with cbenc_release, its owner frees it (also after an error).
+*/
+#define CBOR_ENCODER_MEM_CTX_INITIALIZER(resize, reserve, usrdata) \
+  {0, 0, reserve, usrdata, resize, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {0}, {0}}
+
+/**
+ * Initializer for encoder context that only measures encoded size
+ *
+ * @note Encoding calls work as usual, but data is not written anywhere, get its size with
+ *       cbenc_size. The context has no buffer, items are only counted, also by cbenc_put_*
+ *       calls after cbenc_reserve of any size.
+*/
+#define CBOR_ENCODER_MEASURE_CTX_INITIALIZER \
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {0}, {0}}
+
+/**
+ * Initializer for encoder context with vectored (scatter-gather) output
+ *
+ * @param writev  - vectored write callback, gets the segments of encoded data in order
+ * @param buf     - ptr to buffer
+ * @param bufsz   - buffer size (min 9 bytes!)
+ * @param iov     - ptr to segment list
+ * @param iovmax  - segment list size
+ * @param usrdata - ptr to user data
+ *
+ * @note Headers and small data are encoded into the buffer, string and typed array data of at
+ *       least CBOR_ENCODER_IOV_REF_SIZE bytes is listed as a segment of its own, without copying
+ *       it. Such data must stay valid until the next flush: when the buffer or the segment list
+ *       is full, and on cbenc_end. Data inside containers opened by cbenc_array_open or
+ *       cbenc_map_open is copied.
+*/
+#define CBOR_ENCODER_IOV_CTX_INITIALIZER(writev, buf, bufsz, iov, iovmax, usrdata) \
+  {0, buf, bufsz, usrdata, 0, writev, iov, iovmax, 0, 0, 0, 0, 0, 0, 0, {0}, {0}}
 
 /**
  * Start encoding
@@ -226,9 +377,47 @@ cbor_status cbenc_begin(cbenc_ctx_t *ctx);
  *
  * @param  ctx - encoder context
  * @return status code
+ *
+ * @brief  Writes the rest of the buffer, then calls the sync callback (if set), which may wait
+ *         for writes still in progress.
 */
 cbor_status cbenc_end(cbenc_ctx_t *ctx);
 
+/**
+ * Take growable buffer with encoded data
+ *
+ * @param  ctx  - encoder context
+ * @param  data - ptr to buffer
+ * @param  sz   - size of encoded data
+ * @return status code
+ *
+ * @brief  Passes the buffer to the caller without copying. The next cbenc_begin allocates a new
+ *         one of the same size. Without cbenc_release, cbenc_begin reuses the buffer for the
+ *         next message.
+*/
+cbor_status cbenc_release(cbenc_ctx_t *ctx, void **data, cbor_uint *sz);
+
+/**
+ * Get number of bytes encoded since cbenc_begin
+ *
+ * @param  ctx - encoder context
+ * @return encoded size, including data not flushed yet
+*/
+cbor_uint cbenc_size(cbenc_ctx_t *ctx);
+
+/**
+ * Switch encoder to another buffer
+ *
+ * @param  ctx   - encoder context
+ * @param  buf   - ptr to buffer
+ * @param  bufsz - buffer size, not less then the replaced one
+ *
+ * @note   Call from the write callback only, to keep writing the passed data while the encoder
+ *         fills the new buffer (double buffering). Data left in the old buffer after the written
+ *         part is moved to the new one.
+*/
+void cbenc_set_buffer(cbenc_ctx_t *ctx, uint8_t *buf, cbor_uint bufsz);
+
 /**
  * Encode signed and unsigned int value
  *
@@ -239,6 +428,20 @@ cbor_status cbenc_end(cbenc_ctx_t *ctx);
 cbor_status cbenc_uint(cbenc_ctx_t *ctx, cbor_uint val);
 cbor_status cbenc_int(cbenc_ctx_t *ctx, cbor_int val);
 
+/**
+ * Encode array of signed or unsigned int values
+ *
+ * @param  ctx   - encoder context
+ * @param  vals  - ptr to values
+ * @param  count - number of values
+ * @return status code
+ *
+ * @brief  Writes array header and all values, as cbenc_uint or cbenc_int would, with one buffer
+ *         space check per batch of values.
+ */
+cbor_status cbenc_uint_array(cbenc_ctx_t *ctx, const cbor_uint *vals, cbor_uint count);
+cbor_status cbenc_int_array(cbenc_ctx_t *ctx, const cbor_int *vals, cbor_uint count);
+
 #ifdef CBOR_ENABLE_FLOAT32_SUPPORT
 
 /**
@@ -251,6 +454,19 @@ cbor_status cbenc_int(cbenc_ctx_t *ctx, cbor_int val);
 cbor_status cbenc_float16(cbenc_ctx_t *ctx, float val);
 cbor_status cbenc_float32(cbenc_ctx_t *ctx, float val);
 
+/**
+ * Encode array of half float values
+ *
+ * @param  ctx   - encoder context
+ * @param  vals  - ptr to values
+ * @param  count - number of values
+ * @return status code
+ *
+ * @brief  Writes array header and all values, as cbenc_float16 would. Values are converted in
+ *         batches (with F16C where available).
+ */
+cbor_status cbenc_float16_array(cbenc_ctx_t *ctx, const float *vals, cbor_uint count);
+
 #endif
 
 #ifdef CBOR_ENABLE_FLOAT64_SUPPORT
@@ -264,6 +480,31 @@ cbor_status cbenc_float32(cbenc_ctx_t *ctx, float val);
  */
 cbor_status cbenc_float64(cbenc_ctx_t *ctx, double val);
 
+/**
+ * Encode array of double values
+ *
+ * @param  ctx   - encoder context
+ * @param  vals  - ptr to values
+ * @param  count - number of values
+ * @return status code
+ *
+ * @brief  Writes array header and all values, as cbenc_float64 would.
+ */
+cbor_status cbenc_float64_array(cbenc_ctx_t *ctx, const double *vals, cbor_uint count);
+
+/**
+ * Encode double value as the shortest float that holds it exactly
+ *
+ * @param  ctx - encoder context
+ * @param  val - value to encode
+ * @return status code
+ *
+ * @brief  Preferred serialization of RFC 8949: half float, float or double, whichever is the
+ *         shortest without loss. NaN payload is kept. Half and single values are decoded as
+ *         cbor_tfloat32.
+ */
+cbor_status cbenc_float(cbenc_ctx_t *ctx, double val);
+
 #endif
 
 /**
@@ -331,7 +572,8 @@ cbor_status cbenc_textstr(cbenc_ctx_t *ctx, const char *data, cbor_uint sz);
  * @brief  If string length less than CBOR_UINT_MAX, will be used fixed size, otherwise a variable
  *         length.
  *
- *         The data must be a valid utf-8 string.
+ *         The data must be a valid utf-8 string. With CBOR_ENABLE_UTF8_SUPPORT, a string with
+ *         malformed sequence is written up to it.
 */
 cbor_status cbenc_cstring(cbenc_ctx_t *ctx, const char *data);
 
@@ -375,6 +617,21 @@ cbor_status cbenc_textstr_begin_sz(cbenc_ctx_t *ctx, cbor_uint sz);
 */
 cbor_status cbenc_swrite(cbenc_ctx_t *ctx, const void *data, cbor_uint sz);
 
+/**
+ * Let the caller write byte or text string's data to the output itself
+ *
+ * @param  ctx - encoder context
+ * @param  sz  - data size
+ * @return status code: cbor_eagain if the data must go through cbenc_swrite
+ *
+ * @brief  Writes all encoded data and calls the sync callback, then counts sz bytes as written:
+ *         the caller writes them right after this call. Growable buffer and data inside
+ *         containers opened by cbenc_array_open or cbenc_map_open can not be bypassed. In measure
+ *         mode the data is only counted, also inside open containers. Use with
+ *         cbenc_bytestr_begin_sz or cbenc_textstr_begin_sz.
+*/
+cbor_status cbenc_sbypass(cbenc_ctx_t *ctx, cbor_uint sz);
+
 /**
  * Begin encode array with variable length
  *
@@ -419,6 +676,37 @@ cbor_status cbenc_map_begin(cbenc_ctx_t *ctx);
 */
 cbor_status cbenc_map(cbenc_ctx_t *ctx, cbor_uint sz);
 
+/**
+ * Open array or map with the number of items not known yet
+ *
+ * @param  ctx  - encoder context
+ * @param  mark - position of the container header, for cbenc_close
+ * @return status code
+ *
+ * @brief  Writes a header with room for any count, call other encode functions to write the
+ *         items, then cbenc_close. Containers opened inside must be closed first, up to
+ *         CBOR_ENCODER_MAX_DEPTH can be open (cbor_enomem beyond).
+ *
+ * @note   In write mode the data of open containers stays in the buffer until the outermost one
+ *         is closed, an item that does not fit next to it is reported as cbor_enomem. Use
+ *         growable buffer for containers of any size.
+*/
+cbor_status cbenc_array_open(cbenc_ctx_t *ctx, cbor_uint *mark);
+cbor_status cbenc_map_open(cbenc_ctx_t *ctx, cbor_uint *mark);
+
+/**
+ * Close array or map opened by cbenc_array_open or cbenc_map_open
+ *
+ * @param  ctx   - encoder context
+ * @param  mark  - container mark
+ * @param  count - number of array items or map pairs
+ * @return status code: cbor_efmt if mark is not of the innermost open container
+ *
+ * @brief  Patches in the count with the shortest header and moves the container data up, so the
+ *         output is the same as with cbenc_array or cbenc_map.
+*/
+cbor_status cbenc_close(cbenc_ctx_t *ctx, cbor_uint mark, cbor_uint count);
+
 /**
  * Encode break code for containers with variable length.
  *
@@ -436,34 +724,300 @@ cbor_status cbenc_break(cbenc_ctx_t *ctx);
 */
 cbor_status cbenc_tag(cbenc_ctx_t *ctx, cbor_uint tag);
 
+#ifdef CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+/**
+ * Encode typed array (RFC 8746)
+ *
+ * @param  ctx   - encoder context
+ * @param  tag   - typed array tag: cbor_tag_ta_*
+ * @param  data  - ptr to elements in host byte order
+ * @param  count - number of elements
+ * @return status code
+ *
+ * @brief  Writes the tag and a byte string with all elements. If the byte order of the tag
+ *         matches the host, data is written as is, otherwise elements are byte swapped through
+ *         the encoder buffer. A tag that is not a typed array one is reported as cbor_efmt.
+*/
+cbor_status cbenc_typed_array(cbenc_ctx_t *ctx, cbor_tag tag, const void *data, cbor_uint count);
+
+#endif
+
+/**
+ * Reserve buffer space for cbenc_put_* calls
+ *
+ * @param  ctx - encoder context
+ * @param  sz  - number of bytes
+ * @return status code
+ *
+ * @brief  Flushes the buffer (or grows growable one) if less than sz bytes are available. Larger
+ *         size than the buffer can hold is reported as cbor_enomem. An item header takes up to
+ *         CBOR_ENCODER_MIN_BUFFER_SIZE bytes, float up to 9 bytes, string the header and its size.
+ *         In measure mode any size succeeds.
+*/
+cbor_status cbenc_reserve(cbenc_ctx_t *ctx, cbor_uint sz);
+
+/**
+ * Check for measure mode: no write, resize or writev callback
+ *
+ * @param  ctx - encoder context
+ * @return not zero in measure mode
+*/
+CBOR_INLINE int cbenc_measuring(cbenc_ctx_t *ctx)
+{
+  return !ctx->write && !ctx->resize && !ctx->writev;
+}
+
+/**
+ * Count bytes of unchecked encoder in measure mode, which has no buffer to write to
+ *
+ * @param  ctx - encoder context
+ * @param  sz  - number of bytes
+ * @return not zero in measure mode
+*/
+CBOR_INLINE int cbenc_put_measured(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  if(!cbenc_measuring(ctx)) { return 0; }
+
+  ctx->size += sz;
+  return 1;
+}
+
+/**
+ * Get item header size
+ *
+ * @param  val - argument
+ * @return number of bytes
+*/
+CBOR_INLINE cbor_uint cbenc_header_size(cbor_uint val)
+{
+#if CBOR_UINT_MAX > 0xFFFFFFFFUL
+  if(val > 0xFFFFFFFFUL) { return 9; }
+#endif
+
+#if CBOR_UINT_MAX > 0xFFFF
+  if(val > 0xFFFF) { return 5; }
+#endif
+
+#if CBOR_UINT_MAX > 0xFF
+  if(val > 0xFF) { return 3; }
+#endif
+
+  return (val < 24)? 1 : 2;
+}
+
+/**
+ * Encode item header into reserved space, without space checks
+ *
+ * @param ctx  - encoder context
+ * @param type - major type: cbor_tuint ... cbor_tsimple
+ * @param val  - argument
+*/
+CBOR_INLINE void cbenc_put_header(cbenc_ctx_t *ctx, uint8_t type, cbor_uint val)
+{
+  uint8_t *p = ctx->end;
+
+  if(cbenc_put_measured(ctx, cbenc_header_size(val))) { return; }
+
+  if(val < 24) {
+    p[0] = (uint8_t)(type | val);
+    ctx->end = p + 1;
+    return;
+  }
+
+#if CBOR_UINT_MAX > 0xFFFFFFFFUL
+  if(val > 0xFFFFFFFFUL) {
+    p[0] = type | 27;
+    p[1] = (uint8_t)(val >> 56); p[2] = (uint8_t)(val >> 48);
+    p[3] = (uint8_t)(val >> 40); p[4] = (uint8_t)(val >> 32);
+    p[5] = (uint8_t)(val >> 24); p[6] = (uint8_t)(val >> 16);
+    p[7] = (uint8_t)(val >> 8);  p[8] = (uint8_t)val;
+    ctx->end = p + 9;
+    return;
+  }
+#endif
+
+#if CBOR_UINT_MAX > 0xFFFF
+  if(val > 0xFFFF) {
+    p[0] = type | 26;
+    p[1] = (uint8_t)(val >> 24); p[2] = (uint8_t)(val >> 16);
+    p[3] = (uint8_t)(val >> 8);  p[4] = (uint8_t)val;
+    ctx->end = p + 5;
+    return;
+  }
+#endif
+
+#if CBOR_UINT_MAX > 0xFF
+  if(val > 0xFF) {
+    p[0] = type | 25;
+    p[1] = (uint8_t)(val >> 8); p[2] = (uint8_t)val;
+    ctx->end = p + 3;
+    return;
+  }
+#endif
+
+  p[0] = type | 24;
+  p[1] = (uint8_t)val;
+  ctx->end = p + 2;
+}
+
+/**
+ * Unchecked variants of cbenc_* encoders, for space reserved by cbenc_reserve
+ *
+ * @brief  Output is the same as of the checked encoders.
+*/
+CBOR_INLINE void cbenc_put_uint(cbenc_ctx_t *ctx, cbor_uint val)
+{
+  cbenc_put_header(ctx, cbor_tuint, val);
+}
+
+CBOR_INLINE void cbenc_put_int(cbenc_ctx_t *ctx, cbor_int val)
+{
+  if(val < 0) { cbenc_put_header(ctx, cbor_tint, ~(cbor_uint)val); }
+  else        { cbenc_put_header(ctx, cbor_tuint, (cbor_uint)val); }
+}
+
+CBOR_INLINE void cbenc_put_array(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbenc_put_header(ctx, cbor_tarray, sz);
+}
+
+CBOR_INLINE void cbenc_put_map(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  cbenc_put_header(ctx, cbor_tmap, sz);
+}
+
+CBOR_INLINE void cbenc_put_tag(cbenc_ctx_t *ctx, cbor_uint tag)
+{
+  cbenc_put_header(ctx, cbor_ttag, tag);
+}
+
+CBOR_INLINE void cbenc_put_simple(cbenc_ctx_t *ctx, cbor_simple val)
+{
+  if(cbenc_put_measured(ctx, 1)) { return; }
+  *ctx->end++ = (uint8_t)(cbor_tsimple | val);
+}
+
+CBOR_INLINE void cbenc_put_break(cbenc_ctx_t *ctx)
+{
+  if(cbenc_put_measured(ctx, 1)) { return; }
+  *ctx->end++ = cbor_tsimple | 31;
+}
+
+CBOR_INLINE void cbenc_put_bytestr(cbenc_ctx_t *ctx, const void *data, cbor_uint sz)
+{
+  cbenc_put_header(ctx, cbor_tbytestr, sz);
+  if(cbenc_put_measured(ctx, sz)) { return; }
+  memcpy(ctx->end, data, sz);
+  ctx->end += sz;
+}
+
+CBOR_INLINE void cbenc_put_textstr(cbenc_ctx_t *ctx, const char *data, cbor_uint sz)
+{
+  cbenc_put_header(ctx, cbor_ttextstr, sz);
+  if(cbenc_put_measured(ctx, sz)) { return; }
+  memcpy(ctx->end, data, sz);
+  ctx->end += sz;
+}
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+
+CBOR_INLINE void cbenc_put_float32(cbenc_ctx_t *ctx, float val)
+{
+  union { float f; uint32_t u; } v;
+  uint8_t *p = ctx->end;
+
+  v.f = val;
+#ifdef CBOR_ENABLE_FLOAT_ZERO_AS_UINT
+  if(v.u == 0) {
+    if(!cbenc_put_measured(ctx, 1)) { *ctx->end++ = 0; }
+    return;
+  }
+#endif
+
+  if(cbenc_put_measured(ctx, 5)) { return; }
+
+  p[0] = cbor_tsimple | 26;
+  p[1] = (uint8_t)(v.u >> 24); p[2] = (uint8_t)(v.u >> 16);
+  p[3] = (uint8_t)(v.u >> 8);  p[4] = (uint8_t)v.u;
+  ctx->end = p + 5;
+}
+
+#endif
+
+#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
+
+CBOR_INLINE void cbenc_put_float64(cbenc_ctx_t *ctx, double val)
+{
+  union { double f; uint64_t u; } v;
+  uint8_t *p = ctx->end;
+
+  v.f = val;
+#ifdef CBOR_ENABLE_FLOAT_ZERO_AS_UINT
+  if(v.u == 0) {
+    if(!cbenc_put_measured(ctx, 1)) { *ctx->end++ = 0; }
+    return;
+  }
+#endif
+
+  if(cbenc_put_measured(ctx, 9)) { return; }
+
+  p[0] = cbor_tsimple | 27;
+  p[1] = (uint8_t)(v.u >> 56); p[2] = (uint8_t)(v.u >> 48);
+  p[3] = (uint8_t)(v.u >> 40); p[4] = (uint8_t)(v.u >> 32);
+  p[5] = (uint8_t)(v.u >> 24); p[6] = (uint8_t)(v.u >> 16);
+  p[7] = (uint8_t)(v.u >> 8);  p[8] = (uint8_t)v.u;
+  ctx->end = p + 9;
+}
+
+#endif
+
 #endif // CBOR_ENABLE_ENCODER_SUPPORT
 
 #ifdef CBOR_ENABLE_DECODER_SUPPORT
 
-typedef struct cbdec_ctx
-{
-  // public:
-  cbor_status (*read)(void *data, cbor_uint sz, void *usrdata); // data read callback
-  void *usrdata; // user data pointer
-  cbor_token token; // current token (read only!)
+#define CBOR_DECODER_MIN_BUFFER_SIZE 8
 
-  union {
-    cbor_int    s;
-    cbor_uint   u;
+typedef union
+{
+  cbor_int    s;
+  cbor_uint   u;
 
 #ifdef CBOR_ENABLE_FLOAT32_SUPPORT
-    float       f32;
+  float       f32;
 #endif
 
 #ifdef CBOR_ENABLE_FLOAT64_SUPPORT
-    double      f64;
+  double      f64;
 #endif
 
-    cbor_simple st;
-  } value; // current object value or length (read only!)
+  cbor_simple st;
+} cbor_value;
+
+typedef struct cbdec_ctx
+{
+  // public:
+  cbor_status (*read)(void *data, cbor_uint sz, void *usrdata); // data read callback
+  void *usrdata; // user data pointer
+  cbor_token token; // current token (read only!)
+
+  cbor_value value; // current object value or length (read only!)
+
+  cbor_status (*fill)(void *data, cbor_uint *sz, void *usrdata); // read-ahead callback
+  uint8_t *rabuf; // pointer to read-ahead buffer
+  cbor_uint rabufsz; // read-ahead buffer size (not less then: CBOR_DECODER_MIN_BUFFER_SIZE)
+  uint8_t utf8; // validate text strings as UTF-8, if not zero (requires CBOR_ENABLE_UTF8_SUPPORT)
 
   // private:
   uint8_t buf[8];
+  const uint8_t *pos;
+  const uint8_t *end;
+  const cbor_iovec_t *iov;
+  size_t iovcnt;
+  uint8_t utf8tmp[4];
+  uint8_t utf8len;
+  cbor_uint stack[CBOR_DECODER_MAX_DEPTH];
+  uint8_t varlen[CBOR_DECODER_MAX_DEPTH];
 } cbdec_ctx_t;
 
 /**
@@ -473,7 +1027,51 @@ typedef struct cbdec_ctx
  * @param usrdata - ptr to user data
 */
 #define CBOR_DECODER_CTX_INITIALIZER(read, usrdata) \
-  {read, usrdata, cbor_tinvalid, 0, {0, 0, 0, 0, 0, 0, 0, 0}}
+  {read, usrdata, cbor_tinvalid, {0}, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0, 0}, 0, 0, 0, 0, \
+   {0, 0, 0, 0}, 0, {0}, {0}}
+
+/**
+ * Initializer for decoder context working on contiguous memory
+ *
+ * @param data - ptr to encoded data
+ * @param sz   - data size
+ *
+ * @brief The decoder advances a cursor over the data, no read callback is used. Reaching the end
+ *        of data is reported as cbor_eos.
+*/
+#define CBOR_DECODER_MEM_CTX_INITIALIZER(data, sz) \
+  {0, 0, cbor_tinvalid, {0}, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0, 0}, (const uint8_t*)(data), \
+   (const uint8_t*)(data) + (sz), 0, 0, {0, 0, 0, 0}, 0, {0}, {0}}
+
+/**
+ * Initializer for decoder context with read-ahead buffer
+ *
+ * @param fill    - read-ahead callback
+ * @param buf     - ptr to buffer
+ * @param bufsz   - buffer size (min 8 bytes!)
+ * @param usrdata - ptr to user data
+ *
+ * @brief The fill callback reads up to *sz bytes and stores the number of bytes actually read in
+ *        *sz. Zero bytes or cbor_eos means end of stream. The decoder pulls data in chunks of
+ *        bufsz bytes and serves cbdec_step and cbdec_sread from the buffer, string reads larger
+ *        than the buffer go directly to the caller's memory.
+*/
+#define CBOR_DECODER_BUF_CTX_INITIALIZER(fill, buf, bufsz, usrdata) \
+  {0, usrdata, cbor_tinvalid, {0}, fill, buf, bufsz, 0, {0, 0, 0, 0, 0, 0, 0, 0}, 0, 0, 0, 0, \
+   {0, 0, 0, 0}, 0, {0}, {0}}
+
+/**
+ * Initializer for decoder context working on a chain of memory segments
+ *
+ * @param iov    - ptr to segments array
+ * @param iovcnt - number of segments
+ *
+ * @brief Items may span segment boundaries. Segments are not coalesced: only headers split
+ *        between segments are copied, cbdec_sview returns string data by one piece per segment.
+*/
+#define CBOR_DECODER_IOV_CTX_INITIALIZER(iov, iovcnt) \
+  {0, 0, cbor_tinvalid, {0}, 0, 0, 0, 0, {0, 0, 0, 0, 0, 0, 0, 0}, 0, 0, iov, iovcnt, \
+   {0, 0, 0, 0}, 0, {0}, {0}}
 
 /**
  * Perform one decoder step
@@ -492,6 +1090,345 @@ cbor_status cbdec_step(cbdec_ctx_t *ctx);
 */
 cbor_status cbdec_sread(cbdec_ctx_t *ctx, void *data, cbor_uint sz);
 
+/**
+ * Get byte or text string's data without copying
+ *
+ * @param  ctx  - decoder context
+ * @param  data - ptr to data
+ * @param  sz   - data size
+ * @return status code
+ *
+ * @brief  Returns the next piece of string data as a pointer into decoder memory and decrements
+ *         ctx->value.u by its size. For memory decoder the piece is always the whole remaining
+ *         string. For read-ahead decoder it is limited by the buffer content, for segments
+ *         decoder by the segment, for the read callback decoder by 8 bytes, so call cbdec_sview
+ *         while ctx->value.u is not zero.
+ *
+ *         The pointer stays valid until the next decoder call, for memory decoder it points into
+ *         the input and stays valid as long as the input does.
+ *
+ *         With ctx->utf8 set, text string pieces are validated and cbor_efmt is returned for
+ *         malformed UTF-8. The same applies to cbdec_sread and cbdec_schunk.
+*/
+cbor_status cbdec_sview(cbdec_ctx_t *ctx, const void **data, cbor_uint *sz);
+
+/**
+ * Let the caller read byte or text string's data from the input itself
+ *
+ * @param  ctx - decoder context
+ * @param  sz  - data size, not more then ctx->value.u
+ * @return status code: cbor_eagain while the data is in decoder memory
+ *
+ * @brief  Decrements ctx->value.u by sz, the caller reads sz bytes right after the data the
+ *         decoder has read. String data in the read-ahead buffer must be taken with cbdec_sview
+ *         first, memory and segments decoders always return cbor_eagain, as well as text strings
+ *         validated as UTF-8.
+*/
+cbor_status cbdec_sbypass(cbdec_ctx_t *ctx, cbor_uint sz);
+
+/**
+ * Decode array items into array of unsigned, signed int or double values
+ *
+ * @param  ctx   - decoder context
+ * @param  vals  - ptr to values
+ * @param  count - number of items to decode
+ * @param  n     - number of decoded items
+ * @return status code
+ *
+ * @brief  Call after cbdec_step returned an array, with count of its items (or the capacity of
+ *         vals for an array with variable length). Decodes items in place while they are in the
+ *         decoder window, without a cbdec_step call per item.
+ *
+ *         Stops on cbor_tbreak with cbor_ok, and on an item of another type with cbor_efmt. In
+ *         both cases ctx holds the item that stopped decoding. Signed int array accepts uint and
+ *         int items that fit cbor_int, float array accepts integers and half or single floats,
+ *         double array accepts any number.
+*/
+cbor_status cbdec_uint_array(cbdec_ctx_t *ctx, cbor_uint *vals, cbor_uint count, cbor_uint *n);
+cbor_status cbdec_int_array(cbdec_ctx_t *ctx, cbor_int *vals, cbor_uint count, cbor_uint *n);
+
+#ifdef CBOR_ENABLE_FLOAT32_SUPPORT
+cbor_status cbdec_float32_array(cbdec_ctx_t *ctx, float *vals, cbor_uint count, cbor_uint *n);
+#endif
+
+#ifdef CBOR_ENABLE_FLOAT64_SUPPORT
+cbor_status cbdec_float64_array(cbdec_ctx_t *ctx, double *vals, cbor_uint count, cbor_uint *n);
+#endif
+
+#ifdef CBOR_ENABLE_TYPED_ARRAY_SUPPORT
+
+/**
+ * Read elements of typed array (RFC 8746)
+ *
+ * @param  ctx   - decoder context
+ * @param  tag   - typed array tag, as returned by cbdec_step for cbor_ttag token
+ * @param  data  - ptr to elements
+ * @param  count - max number of elements to read
+ * @return status code
+ *
+ * @brief  Call after cbdec_step returned the byte string following the tag. Reads up to count
+ *         elements, converts them to host byte order and decrements ctx->value.u by the size
+ *         read, as cbdec_sread does, so a large array may be read in parts. A tag that is not a
+ *         typed array one, or a string size that is not a multiple of the element size, is
+ *         reported as cbor_efmt.
+*/
+cbor_status cbdec_typed_array(cbdec_ctx_t *ctx, cbor_uint tag, void *data, cbor_uint count);
+
+#endif
+
+/**
+ * Skip current item
+ *
+ * @param  ctx - decoder context
+ * @return status code
+ *
+ * @brief  Call after cbdec_step to skip the rest of the current item: string data, all elements
+ *         of an array or map, or the item following a tag. After return, the next cbdec_step
+ *         reads the item that follows. Memory decoder skips string data without reading it.
+ *
+ *         Containers with variable length nested deeper than CBOR_DECODER_MAX_DEPTH are
+ *         reported as cbor_enomem.
+*/
+cbor_status cbdec_skip(cbdec_ctx_t *ctx);
+
+/**
+ * Find map value by text string key
+ *
+ * @param  ctx    - decoder context
+ * @param  key    - ptr to key
+ * @param  keylen - key size
+ * @return status code (cbor_eos, if there is no such key)
+ *
+ * @brief  Call after cbdec_step returned cbor_tmap or cbor_tvmap token. Keys are compared in
+ *         place, other entries are skipped. On success the value is decoded as by cbdec_step,
+ *         the map entries after it are not read. If the key is not found, the whole map is read.
+ *         A break in place of a key or value of the entries read is reported as cbor_efmt.
+*/
+cbor_status cbdec_map_find(cbdec_ctx_t *ctx, const char *key, cbor_uint keylen);
+
+typedef struct cbdec_key
+{
+  // public:
+  const char *key; // key string
+  cbor_uint len; // key size
+  cbor_token token; // value token, cbor_tinvalid if the key was not found (read only!)
+  cbor_value value; // value or length (read only!)
+  const void *data; // ptr to encoded value, memory decoder only (read only!)
+  cbor_uint sz; // encoded value size (read only!)
+
+  // private:
+  uint32_t hash;
+  uint8_t match;
+} cbdec_key_t;
+
+/**
+ * Initializer for map key
+ *
+ * @param key - string literal
+*/
+#define CBOR_MAP_KEY_INITIALIZER(key) {key, sizeof(key) - 1, cbor_tinvalid, {0}, 0, 0, 0, 0}
+
+/**
+ * Prepare map keys for cbdec_map_keys
+ *
+ * @param keys - ptr to keys array
+ * @param n    - number of keys
+ *
+ * @brief Precomputes key hashes, call once after the key and len fields are set.
+*/
+void cbdec_map_keys_init(cbdec_key_t *keys, size_t n);
+
+/**
+ * Find values for a set of text string keys
+ *
+ * @param  ctx  - decoder context
+ * @param  keys - ptr to keys array
+ * @param  n    - number of keys
+ * @return status code
+ *
+ * @brief  Call after cbdec_step returned cbor_tmap or cbor_tvmap token. Reads the whole map in
+ *         one pass and fills token and value for every key found. Nested values of containers
+ *         and strings are skipped: for memory decoder data and sz hold the encoded value, which
+ *         can be decoded with another memory decoder context, otherwise they are zero. When the
+ *         same key occurs more than once, the first value is kept. A map with variable length
+ *         and odd number of items is reported as cbor_efmt.
+*/
+cbor_status cbdec_map_keys(cbdec_ctx_t *ctx, cbdec_key_t *keys, size_t n);
+
+/**
+ * Iterate over chunks of byte or text string with variable length
+ *
+ * @param  ctx  - decoder context
+ * @param  data - ptr to chunk data
+ * @param  sz   - chunk data size
+ * @return status code
+ *
+ * @brief  Call after cbdec_step returned cbor_tvbytestr or cbor_tvtextstr token, then again until
+ *         the string is over. Steps to the next chunk and returns its data as cbdec_sview does.
+ *         With read callback or read-ahead buffer the data may come in pieces: while the chunk
+ *         has data left (ctx->value.u), the next call returns its next piece. When the string is
+ *         over, ctx->token is set to cbor_tbreak.
+ *
+ *         while(cbdec_schunk(ctx, &data, &sz) == cbor_ok && ctx->token != cbor_tbreak) { ... }
+*/
+cbor_status cbdec_schunk(cbdec_ctx_t *ctx, const void **data, cbor_uint *sz);
+
+#define CBOR_VALIDATE_UTF8     0x01 // check that text strings are valid UTF-8
+#define CBOR_VALIDATE_SEQUENCE 0x02 // accept a sequence of items (RFC 8742)
+
+/**
+ * Check that encoded data is well-formed
+ *
+ * @param  data  - ptr to encoded data
+ * @param  sz    - data size
+ * @param  flags - CBOR_VALIDATE_* flags
+ * @return status code
+ *
+ * @brief  Checks every header as cbdec_step does, that strings fit into the data, that breaks
+ *         close variable length containers and strings (which contain only chunks of their own
+ *         type), that maps have even number of items and that no data follows the item. Truncated
+ *         data is reported as cbor_eos, malformed data as cbor_efmt and containers with variable
+ *         length nested deeper than CBOR_DECODER_MAX_DEPTH as cbor_enomem.
+ *
+ *         Nothing is decoded, so validating is much cheaper than a decoder pass. An empty
+ *         sequence is valid.
+*/
+cbor_status cbdec_validate(const void *data, size_t sz, unsigned flags);
+
+typedef struct cbpush_ctx
+{
+  // public:
+  cbor_token token; // current token (read only!)
+  cbor_value value; // current object value or length (read only!)
+
+  // private:
+  uint8_t hdr[9];
+  uint8_t have;
+} cbpush_ctx_t;
+
+/**
+ * Initializer for push decoder context
+*/
+#define CBOR_PUSH_CTX_INITIALIZER {cbor_tinvalid, {0}, {0, 0, 0, 0, 0, 0, 0, 0, 0}, 0}
+
+/**
+ * Perform one push decoder step on input fragment
+ *
+ * @param  ctx  - push decoder context
+ * @param  data - ptr to input fragment
+ * @param  sz   - fragment size
+ * @param  used - number of bytes consumed from the fragment
+ * @return status code (cbor_eagain, if the fragment ended before the item header)
+ *
+ * @brief  Decodes the next item header like cbdec_step, but takes input as fragments of any
+ *         size. When a header is split between fragments, its first part is kept in the context
+ *         and decoding continues with the next fragment. Unread data of the previous byte or
+ *         text string is skipped first, so call cbpush_sview to consume it.
+ *
+ *         The context keeps no pointers to input and fits in a cache line.
+*/
+cbor_status cbpush_step(cbpush_ctx_t *ctx, const void *data, cbor_uint sz, cbor_uint *used);
+
+/**
+ * Consume byte or text string's data from input fragment
+ *
+ * @param  ctx  - push decoder context
+ * @param  sz   - fragment size
+ * @param  used - number of string bytes at the beginning of the fragment
+ * @return status code (cbor_eagain, if the string continues in the next fragment)
+ *
+ * @brief  The string data is the first used bytes of the fragment, it's not copied.
+*/
+cbor_status cbpush_sview(cbpush_ctx_t *ctx, cbor_uint sz, cbor_uint *used);
+
+#ifdef CBOR_ENABLE_TAPE_SUPPORT
+
+typedef struct cbtape_item
+{
+  size_t offset; // offset of the item's initial byte in the data
+  size_t next; // index of the item following this item and all its nested items
+  cbor_token token; // item token
+
+  cbor_value value; // item value or length (see cbtape_parse)
+} cbtape_item_t;
+
+typedef struct cbtape
+{
+  // public:
+  cbtape_item_t *items; // pointer to items array
+  size_t size; // items array size
+  size_t count; // number of parsed items (read only!)
+
+  // private:
+  const uint8_t *data;
+} cbtape_t;
+
+/**
+ * Initializer for tape index
+ *
+ * @param items - ptr to items array
+ * @param size  - number of items in array
+*/
+#define CBOR_TAPE_INITIALIZER(items, size) {items, size, 0, 0}
+
+/**
+ * Build tape index
+ *
+ * @param  tape - tape index
+ * @param  data - ptr to encoded data
+ * @param  sz   - data size
+ * @return status code
+ *
+ * @brief  Parses the data (one item or a sequence of items) in a single pass and stores every
+ *         item to the tape in encoding order. Breaks are not stored. For arrays and containers
+ *         with variable length the value is the number of nested items (for maps, the number of
+ *         key-value pairs), for strings with variable length it's the number of chunks, for tags
+ *         it's the tag number.
+ *
+ *         The data must remain valid while the tape is used.
+*/
+cbor_status cbtape_parse(cbtape_t *tape, const void *data, cbor_uint sz);
+
+/**
+ * Find container element by position
+ *
+ * @param  tape - tape index
+ * @param  idx  - index of array, map, tag or string with variable length item
+ * @param  n    - element position (in maps keys and values are counted separately)
+ * @param  res  - index of the found item
+ * @return status code (cbor_eos, if there is no such element)
+ *
+ * @brief  Constant time when the container holds only scalars and strings, otherwise jumps over
+ *         preceding elements without parsing them.
+*/
+cbor_status cbtape_at(const cbtape_t *tape, size_t idx, cbor_uint n, size_t *res);
+
+/**
+ * Find map value by text string key
+ *
+ * @param  tape   - tape index
+ * @param  idx    - index of map item
+ * @param  key    - ptr to key
+ * @param  keylen - key size
+ * @param  res    - index of the found value
+ * @return status code (cbor_eos, if there is no such key)
+*/
+cbor_status cbtape_find(const cbtape_t *tape, size_t idx, const char *key, cbor_uint keylen,
+                        size_t *res);
+
+/**
+ * Get byte or text string's data without copying
+ *
+ * @param  tape - tape index
+ * @param  idx  - index of string item
+ * @param  data - ptr to data
+ * @param  sz   - data size
+ * @return status code
+*/
+cbor_status cbtape_sview(const cbtape_t *tape, size_t idx, const void **data, cbor_uint *sz);
+
+#endif // CBOR_ENABLE_TAPE_SUPPORT
+
 #endif // CBOR_ENABLE_DECODER_SUPPORT
 
 #ifdef __cplusplus
@@ -0,0 +1,145 @@
+#include <cstdlib>
+#include <unistd.h>
+#include <sched.h>
+#include "cbor-posix.h"
+#include "cbor-test.h"
+
+// temporary file, removed when closed
+static int temp_file()
+{
+  char name[] = "/tmp/cbor-test-XXXXXX";
+  int fd = mkstemp(name);
+
+  TEST_CHECK(fd >= 0);
+  unlink(name);
+  return fd;
+}
+
+static std::vector<uint8_t> file_data(int fd)
+{
+  std::vector<uint8_t> data(lseek(fd, 0, SEEK_END));
+
+  TEST_CHECK(pread(fd, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+  return data;
+}
+
+// file writer called from the writer thread, which must not use test_rand
+struct file
+{
+  int fd;
+  uint32_t writes;
+  uint32_t fail_at;
+};
+
+static cbor_status file_write(const void *data, cbor_uint sz, void *usrdata)
+{
+  file *f = static_cast<file*>(usrdata);
+
+  if(++f->writes == f->fail_at) { return cbor_eio; }
+
+  // every other buffer is slow, so the encoder waits for a written one
+  if(f->writes % 2) { sched_yield(); }
+
+  return (write(f->fd, data, sz) == static_cast<ssize_t>(sz))? cbor_ok : cbor_eio;
+}
+
+// random items, the same for the same seed, strings longer than the buffers included
+static void encode(cbenc_ctx_t *ctx, uint32_t seed, int depth = 0)
+{
+  static uint8_t blob[20000];
+  uint32_t i, n;
+
+  if(depth == 0) {
+    for(i = 0; i < sizeof(blob); i++) { blob[i] = static_cast<uint8_t>(i * 7 + i / 251); }
+    test_seed = seed;
+  }
+
+  for(n = test_rand() % (depth? 6 : 40); n > 0; n--) {
+    switch(test_rand() % ((depth > 2)? 5 : 7)) {
+    case 0: cbenc_uint(ctx, static_cast<cbor_uint>(test_rand()) << test_rand() % 40); break;
+    case 1: cbenc_int(ctx, -static_cast<cbor_int>(test_rand())); break;
+    case 2: cbenc_float64(ctx, test_rand() / 3.0); break;
+    case 3: cbenc_cstring(ctx, "text \xC3\xA9"); break;
+    case 4: cbenc_bytestr(ctx, blob, test_rand() % ((test_rand() % 8)? 50 : sizeof(blob))); break;
+
+    case 5:
+      cbenc_array(ctx, 3);
+      for(i = 0; i < 3; i++) { encode(ctx, seed, depth + 3); }
+      break;
+
+    default:
+      cbenc_array_begin(ctx);
+      encode(ctx, seed, depth + 1);
+      cbenc_break(ctx);
+      break;
+    }
+  }
+}
+
+int main(int, char**)
+{
+  static const cbor_uint bufs[] = {CBOR_ENCODER_MIN_BUFFER_SIZE, 16, 100, 4096};
+  static const unsigned nbufs[] = {2, 3, CBOR_ASYNC_MAX_BUFFERS};
+  std::vector<uint8_t> big(1 << 22), ref, mem, stale(64);
+  uint32_t it, writes;
+  cbor_async_t async;
+  cbor_uint bufsz;
+  unsigned n;
+  int fd;
+
+  for(it = 0; it < 600; it++) {
+    cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, big.data(), big.size(), nullptr);
+    test_out.clear();
+    cbenc_begin(&w);
+    encode(&w, it);
+    cbenc_end(&w);
+    ref = test_out;
+
+    bufsz = bufs[it % 4];
+    n = nbufs[it / 4 % 3];
+    mem.assign(bufsz * n, 0);
+
+    // the context was used before: the item left in its buffer is not written
+    cbenc_ctx_t c = CBOR_ENCODER_CTX_INITIALIZER(test_write, stale.data(), stale.size(), nullptr);
+    cbenc_begin(&c);
+    cbenc_uint(&c, 12345);
+
+    fd = temp_file();
+    file f = {fd, 0, 0};
+    TEST_CHECK(cbor_async_start(&async, &c, mem.data(), bufsz, n, file_write, &f) == cbor_ok);
+    if(it % 2) { cbenc_begin(&c); }
+
+    encode(&c, it);
+    TEST_CHECK(cbenc_end(&c) == cbor_ok);
+    TEST_CHECK(cbor_async_stop(&async) == cbor_ok);
+    TEST_CHECK(file_data(fd) == ref);
+    close(fd);
+
+    // a failed write is returned by cbenc_end and cbor_async_stop, the rest is dropped
+    writes = f.writes;
+    fd = temp_file();
+    f = {fd, 0, 1 + static_cast<uint32_t>(test_rand() % (writes + 1))};
+
+    cbenc_ctx_t e = CBOR_ENCODER_CTX_INITIALIZER(0, 0, 0, 0);
+    TEST_CHECK(cbor_async_start(&async, &e, mem.data(), bufsz, n, file_write, &f) == cbor_ok);
+    encode(&e, it);
+
+    cbor_status expect = (f.fail_at <= writes)? cbor_eio : cbor_ok;
+    TEST_CHECK(cbenc_end(&e) == expect);
+    TEST_CHECK(cbor_async_stop(&async) == expect);
+    TEST_CHECK(f.writes == ((expect == cbor_ok)? writes : f.fail_at));
+    if(expect == cbor_ok) { TEST_CHECK(file_data(fd) == ref); }
+    close(fd);
+  }
+
+  // buffer count and size out of range
+  cbenc_ctx_t c = CBOR_ENCODER_CTX_INITIALIZER(0, 0, 0, 0);
+  mem.assign(1024, 0);
+  TEST_CHECK(cbor_async_start(&async, &c, mem.data(), 16, 1, file_write, nullptr) == cbor_enomem);
+  TEST_CHECK(cbor_async_start(&async, &c, mem.data(), 16, CBOR_ASYNC_MAX_BUFFERS + 1, file_write,
+                              nullptr) == cbor_enomem);
+  TEST_CHECK(cbor_async_start(&async, &c, mem.data(), CBOR_ENCODER_MIN_BUFFER_SIZE - 1, 2,
+                              file_write, nullptr) == cbor_enomem);
+
+  return test_result("async");
+}
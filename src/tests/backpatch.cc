@@ -0,0 +1,168 @@
+#include <cstdlib>
+#include <cstring>
+#include "cbor-test.h"
+
+static uint8_t blob[3000];
+static cbor_uint uints[100];
+static size_t opened;
+
+static void *resize(void *buf, cbor_uint sz, void*)
+{
+  return std::realloc(buf, sz);
+}
+
+static cbor_status test_writev(const cbor_iovec_t *iov, size_t n, void*)
+{
+  for(size_t i = 0; i < n; i++) { test_write(iov[i].base, iov[i].len, nullptr); }
+  return cbor_ok;
+}
+
+// random item, containers with known counts or opened and closed with the count at the end
+static cbor_status encode(cbenc_ctx_t *ctx, bool backpatch, int depth)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint mark = 0;
+  uint32_t i, n;
+  bool map;
+
+  switch(test_rand() % (depth > 4? 6 : 9)) {
+  case 0: return cbenc_uint(ctx, static_cast<cbor_uint>(test_rand()) << test_rand() % 40);
+  case 1: return cbenc_int(ctx, -static_cast<cbor_int>(test_rand()));
+  case 2: return cbenc_bytestr(ctx, blob, test_rand() % (test_rand() % 8? 30 : sizeof(blob)));
+  case 3: return cbenc_cstring(ctx, "key \xC3\xA9");
+  case 4: return cbenc_uint_array(ctx, uints, test_rand() % 100);
+  case 5: return cbenc_typed_array(ctx, cbor_tag_ta_u32be, uints, test_rand() % 50);
+
+  default:
+    // mostly small containers, sometimes a large one at the top
+    map = test_rand() % 3 == 0;
+    n = test_rand() % ((test_rand() % 4 || depth)? 5 : 400);
+
+    if(backpatch) {
+      cs = map? cbenc_map_open(ctx, &mark) : cbenc_array_open(ctx, &mark);
+      opened++;
+    }
+    else { cs = map? cbenc_map(ctx, n) : cbenc_array(ctx, n); }
+
+    for(i = 0; i < n && cs == cbor_ok; i++) {
+      if(map) { cs = cbenc_uint(ctx, i); }
+      if(cs == cbor_ok) { cs = encode(ctx, backpatch, depth + 1); }
+    }
+
+    if(backpatch && cs == cbor_ok) { cs = cbenc_close(ctx, mark, n); }
+    return cs;
+  }
+}
+
+static void check(cbenc_ctx_t *ctx, uint32_t seed, const std::vector<uint8_t> &ref)
+{
+  cbor_status cs;
+
+  test_seed = seed;
+  test_out.clear();
+  opened = 0;
+
+  cbenc_begin(ctx);
+  cs = encode(ctx, true, 0);
+  if(cs == cbor_ok) { cs = cbenc_uint(ctx, 7); }
+  if(cs == cbor_ok) { cs = cbenc_end(ctx); }
+
+  // containers are always definite, a buffer too small for the open ones fails
+  if(cs == cbor_ok) { TEST_CHECK(test_out == ref); }
+  else { TEST_CHECK(cs == cbor_enomem && ctx->bufsz < ref.size() + opened * 8); }
+}
+
+// misuse of marks and nesting
+static void check_marks()
+{
+  uint8_t buf[512];
+  cbor_uint marks[CBOR_ENCODER_MAX_DEPTH + 1];
+  int i;
+
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf, sizeof(buf), nullptr);
+  test_out.clear();
+  cbenc_begin(&w);
+
+  TEST_CHECK(cbenc_close(&w, 0, 0) == cbor_efmt);
+
+  for(i = 0; i < CBOR_ENCODER_MAX_DEPTH; i++) {
+    TEST_CHECK(cbenc_array_open(&w, &marks[i]) == cbor_ok);
+  }
+  TEST_CHECK(cbenc_map_open(&w, &marks[i]) == cbor_enomem);
+
+  // only the innermost one can be closed
+  TEST_CHECK(cbenc_close(&w, marks[0], 1) == cbor_efmt);
+  TEST_CHECK(cbenc_close(&w, marks[i - 2], 1) == cbor_efmt);
+  TEST_CHECK(cbenc_close(&w, marks[i - 1] + 1, 0) == cbor_efmt);
+
+  for(i = CBOR_ENCODER_MAX_DEPTH - 1; i >= 0; i--) {
+    TEST_CHECK(cbenc_close(&w, marks[i], i < CBOR_ENCODER_MAX_DEPTH - 1) == cbor_ok);
+  }
+  TEST_CHECK(cbenc_close(&w, marks[0], 1) == cbor_efmt);
+  TEST_CHECK(cbenc_end(&w) == cbor_ok);
+
+  std::vector<uint8_t> ref(CBOR_ENCODER_MAX_DEPTH - 1, 0x81);
+  ref.push_back(0x80);
+  TEST_CHECK(test_out == ref);
+}
+
+int main(int, char**)
+{
+  std::vector<uint8_t> big(1 << 24), buf, ref;
+  std::vector<cbor_iovec_t> iov(8);
+  uint32_t it, seed;
+  cbor_uint i, sz;
+  void *data;
+
+  for(i = 0; i < 100; i++) { uints[i] = i * i * i * 12345; }
+
+  for(it = 0; it < 2000; it++) {
+    seed = it * 7717 + 3;
+
+    test_seed = seed;
+    test_out.clear();
+    cbenc_ctx_t r = CBOR_ENCODER_CTX_INITIALIZER(test_write, big.data(), big.size(), nullptr);
+    cbenc_begin(&r);
+    TEST_CHECK(encode(&r, false, 0) == cbor_ok);
+    TEST_CHECK(cbenc_uint(&r, 7) == cbor_ok);
+    TEST_CHECK(cbenc_end(&r) == cbor_ok);
+    ref = test_out;
+
+    // same bytes when the whole document fits
+    cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, big.data(), big.size(), nullptr);
+    check(&w, seed, ref);
+    TEST_CHECK(test_out == ref);
+
+    cbenc_ctx_t m = CBOR_ENCODER_MEM_CTX_INITIALIZER(resize, it % 3 * 20, nullptr);
+    test_seed = seed;
+    cbenc_begin(&m);
+    TEST_CHECK(encode(&m, true, 0) == cbor_ok);
+    TEST_CHECK(cbenc_uint(&m, 7) == cbor_ok);
+    TEST_CHECK(cbenc_end(&m) == cbor_ok);
+    cbenc_release(&m, &data, &sz);
+    TEST_CHECK(sz == ref.size() && std::memcmp(data, ref.data(), sz) == 0);
+    std::free(data);
+
+    cbenc_ctx_t ms = CBOR_ENCODER_MEASURE_CTX_INITIALIZER;
+    test_seed = seed;
+    cbenc_begin(&ms);
+    TEST_CHECK(encode(&ms, true, 0) == cbor_ok);
+    TEST_CHECK(cbenc_uint(&ms, 7) == cbor_ok);
+    TEST_CHECK(cbenc_end(&ms) == cbor_ok);
+    TEST_CHECK(cbenc_size(&ms) == ref.size());
+
+    // buffers of any size, down to the smallest one
+    buf.resize(CBOR_ENCODER_MIN_BUFFER_SIZE + it * 37 % 20000);
+
+    cbenc_ctx_t s = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+    check(&s, seed, ref);
+
+    cbenc_ctx_t v = CBOR_ENCODER_IOV_CTX_INITIALIZER(test_writev, buf.data(), buf.size(),
+                                                     iov.data(), iov.size(), nullptr);
+    check(&v, seed, ref);
+  }
+
+  check_marks();
+
+  return test_result("backpatch");
+}
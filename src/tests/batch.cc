@@ -0,0 +1,362 @@
+#include <cstring>
+#include <limits>
+#include "cbor-test.h"
+
+// values of all sizes and edge cases
+static cbor_uint rand_uint()
+{
+  switch(test_rand() % 4) {
+  case 0:  return test_rand() % 30;
+  case 1:  return ~static_cast<cbor_uint>(0) - test_rand() % 3;
+  default: return static_cast<cbor_uint>(test_rand()) << test_rand() % 40;
+  }
+}
+
+static cbor_int rand_int()
+{
+  switch(test_rand() % 4) {
+  case 0:  return std::numeric_limits<cbor_int>::min() + test_rand() % 3;
+  case 1:  return std::numeric_limits<cbor_int>::max() - test_rand() % 3;
+  default: return static_cast<cbor_int>(rand_uint() >> 1) * ((test_rand() % 2)? -1 : 1);
+  }
+}
+
+static double rand_double()
+{
+  static const double special[] = {0.0, -0.0, 1.0, 65504.0, 65520.0, 1e-8, 5.96e-8, 6.1e-5, 1e300,
+                                   std::numeric_limits<double>::infinity(),
+                                   -std::numeric_limits<double>::infinity(),
+                                   std::numeric_limits<double>::quiet_NaN(),
+                                   std::numeric_limits<double>::denorm_min()};
+
+  if(test_rand() % 4 == 0) { return special[test_rand() % (sizeof(special) / sizeof(special[0]))]; }
+  return (static_cast<cbor_int>(test_rand() % 2000000) - 1000000) / (test_rand() % 5000 + 1.0);
+}
+
+typedef cbor_status (*encode_fn)(cbenc_ctx_t*, const void*, cbor_uint, bool batch);
+
+static cbor_status enc_uint(cbenc_ctx_t *ctx, const void *vals, cbor_uint count, bool batch)
+{
+  const cbor_uint *v = static_cast<const cbor_uint*>(vals);
+  cbor_status cs = cbor_ok;
+
+  if(batch) { return cbenc_uint_array(ctx, v, count); }
+  if((cs = cbenc_array(ctx, count)) != cbor_ok) { return cs; }
+  for(cbor_uint i = 0; i < count && cs == cbor_ok; i++) { cs = cbenc_uint(ctx, v[i]); }
+  return cs;
+}
+
+static cbor_status enc_int(cbenc_ctx_t *ctx, const void *vals, cbor_uint count, bool batch)
+{
+  const cbor_int *v = static_cast<const cbor_int*>(vals);
+  cbor_status cs = cbor_ok;
+
+  if(batch) { return cbenc_int_array(ctx, v, count); }
+  if((cs = cbenc_array(ctx, count)) != cbor_ok) { return cs; }
+  for(cbor_uint i = 0; i < count && cs == cbor_ok; i++) { cs = cbenc_int(ctx, v[i]); }
+  return cs;
+}
+
+static cbor_status enc_float16(cbenc_ctx_t *ctx, const void *vals, cbor_uint count, bool batch)
+{
+  const float *v = static_cast<const float*>(vals);
+  cbor_status cs = cbor_ok;
+
+  if(batch) { return cbenc_float16_array(ctx, v, count); }
+  if((cs = cbenc_array(ctx, count)) != cbor_ok) { return cs; }
+  for(cbor_uint i = 0; i < count && cs == cbor_ok; i++) { cs = cbenc_float16(ctx, v[i]); }
+  return cs;
+}
+
+static cbor_status enc_float64(cbenc_ctx_t *ctx, const void *vals, cbor_uint count, bool batch)
+{
+  const double *v = static_cast<const double*>(vals);
+  cbor_status cs = cbor_ok;
+
+  if(batch) { return cbenc_float64_array(ctx, v, count); }
+  if((cs = cbenc_array(ctx, count)) != cbor_ok) { return cs; }
+  for(cbor_uint i = 0; i < count && cs == cbor_ok; i++) { cs = cbenc_float64(ctx, v[i]); }
+  return cs;
+}
+
+// batched encoding gives the same bytes as encoding value by value
+static void check_encode(encode_fn fn, const void *vals, cbor_uint count)
+{
+  std::vector<uint8_t> buf(4096), ref;
+
+  cbenc_ctx_t r = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+  test_out.clear();
+  cbenc_begin(&r);
+  TEST_CHECK(fn(&r, vals, count, false) == cbor_ok && cbenc_end(&r) == cbor_ok);
+  ref = test_out;
+
+  buf.resize(CBOR_ENCODER_MIN_BUFFER_SIZE + test_rand() % (test_rand() % 2? 10 : 300));
+
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+  test_out.clear();
+  cbenc_begin(&w);
+  TEST_CHECK(fn(&w, vals, count, true) == cbor_ok && cbenc_end(&w) == cbor_ok);
+  TEST_CHECK(test_out == ref);
+
+  cbenc_ctx_t m = CBOR_ENCODER_MEASURE_CTX_INITIALIZER;
+  cbenc_begin(&m);
+  TEST_CHECK(fn(&m, vals, count, true) == cbor_ok && cbenc_end(&m) == cbor_ok);
+  TEST_CHECK(cbenc_size(&m) == ref.size());
+}
+
+enum kind { k_uint, k_int, k_float32, k_float64 };
+
+// conversion rules of the batched decoders, applied to items decoded one by one
+static bool put(kind k, const cbdec_ctx_t *ctx, uint8_t *vals, cbor_uint i)
+{
+  cbor_token t = ctx->token;
+  cbor_value v = ctx->value;
+  cbor_uint u;
+  cbor_int s;
+  float f;
+  double d;
+
+  switch(k) {
+  case k_uint:
+    if(t != cbor_tuint) { return false; }
+    u = v.u;
+    std::memcpy(vals + i * sizeof(u), &u, sizeof(u));
+    return true;
+
+  case k_int:
+    if(t != cbor_tuint && t != cbor_tint) { return false; }
+    if((t == cbor_tuint) != (v.s >= 0)) { return false; }
+    s = v.s;
+    std::memcpy(vals + i * sizeof(s), &s, sizeof(s));
+    return true;
+
+  case k_float32:
+    if(t == cbor_tuint) { f = static_cast<float>(v.u); }
+    else if(t == cbor_tint) { f = static_cast<float>(v.s); }
+    else if(t == cbor_tfloat32) { f = v.f32; }
+    else { return false; }
+    std::memcpy(vals + i * sizeof(f), &f, sizeof(f));
+    return true;
+
+  default:
+    if(t == cbor_tuint) { d = static_cast<double>(v.u); }
+    else if(t == cbor_tint) { d = static_cast<double>(v.s); }
+    else if(t == cbor_tfloat32) { d = v.f32; }
+    else if(t == cbor_tfloat64) { d = v.f64; }
+    else { return false; }
+    std::memcpy(vals + i * sizeof(d), &d, sizeof(d));
+    return true;
+  }
+}
+
+static cbor_status batch(kind k, cbdec_ctx_t *ctx, uint8_t *vals, cbor_uint count, cbor_uint *n)
+{
+  switch(k) {
+  case k_uint:    return cbdec_uint_array(ctx, reinterpret_cast<cbor_uint*>(vals), count, n);
+  case k_int:     return cbdec_int_array(ctx, reinterpret_cast<cbor_int*>(vals), count, n);
+  case k_float32: return cbdec_float32_array(ctx, reinterpret_cast<float*>(vals), count, n);
+  default:        return cbdec_float64_array(ctx, reinterpret_cast<double*>(vals), count, n);
+  }
+}
+
+static size_t elem_size(kind k)
+{
+  return (k == k_float32)? sizeof(float) : 8;
+}
+
+static void put_head(std::vector<uint8_t> &out, uint8_t major, uint64_t val)
+{
+  int size;
+
+  if(val < 24) { out.push_back(static_cast<uint8_t>(major | val)); return; }
+
+  if(val <= 0xFF) { out.push_back(major | 24); size = 1; }
+  else if(val <= 0xFFFF) { out.push_back(major | 25); size = 2; }
+  else if(val <= 0xFFFFFFFFu) { out.push_back(major | 26); size = 4; }
+  else { out.push_back(major | 27); size = 8; }
+
+  while(size--) { out.push_back(static_cast<uint8_t>(val >> size * 8)); }
+}
+
+// array of numbers of all encodings, sometimes with an item of another type
+static std::vector<uint8_t> make_array(cbor_uint count, bool var)
+{
+  std::vector<uint8_t> out;
+  uint64_t bits;
+  uint32_t half, single;
+  double d;
+  float f;
+
+  if(var) { out.push_back(0x9F); }
+  else { put_head(out, 0x80, count); }
+
+  for(cbor_uint i = 0; i < count; i++) {
+    switch(test_rand() % 9) {
+    case 0: case 1: put_head(out, 0x00, rand_uint()); break;
+    case 2: case 3: put_head(out, 0x20, rand_uint()); break;
+
+    case 4:
+      half = test_rand() & 0xFFFF;
+      out.push_back(0xF9);
+      out.push_back(static_cast<uint8_t>(half >> 8));
+      out.push_back(static_cast<uint8_t>(half));
+      break;
+
+    case 5:
+      f = static_cast<float>(rand_double());
+      std::memcpy(&single, &f, 4);
+      out.push_back(0xFA);
+      for(int k = 3; k >= 0; k--) { out.push_back(static_cast<uint8_t>(single >> k * 8)); }
+      break;
+
+    case 6:
+      d = rand_double();
+      std::memcpy(&bits, &d, 8);
+      out.push_back(0xFB);
+      for(int k = 7; k >= 0; k--) { out.push_back(static_cast<uint8_t>(bits >> k * 8)); }
+      break;
+
+    case 7:
+      // integer that fits any array
+      put_head(out, (test_rand() % 2)? 0x00 : 0x20, test_rand() % 1000);
+      break;
+
+    default:
+      if(test_rand() % 8) { put_head(out, 0x00, test_rand() % 100); }
+      else if(test_rand() % 2) { out.push_back(0xF5); }
+      else { out.push_back(0x61); out.push_back('a'); }
+      break;
+    }
+  }
+
+  if(var) { out.push_back(0xFF); }
+  out.push_back(0x07);
+
+  return out;
+}
+
+struct source
+{
+  const std::vector<uint8_t> *data;
+  size_t pos;
+};
+
+static cbor_status read(void *data, cbor_uint sz, void *usrdata)
+{
+  source *src = static_cast<source*>(usrdata);
+
+  if(src->data->size() - src->pos < sz) { return cbor_eos; }
+
+  std::memcpy(data, src->data->data() + src->pos, sz);
+  src->pos += sz;
+  return cbor_ok;
+}
+
+static cbor_status fill(void *data, cbor_uint *sz, void *usrdata)
+{
+  source *src = static_cast<source*>(usrdata);
+  cbor_uint n = src->data->size() - src->pos;
+
+  if(n > *sz) { n = *sz; }
+
+  std::memcpy(data, src->data->data() + src->pos, n);
+  src->pos += n;
+  *sz = n;
+  return cbor_ok;
+}
+
+// batched decoding in parts of random size gives the same as decoding item by item
+static void check_decode(kind k, const std::vector<uint8_t> &data, cbor_uint count)
+{
+  size_t size = elem_size(k);
+  std::vector<uint8_t> ref(size * (count + 1)), out(size * (count + 1));
+  std::vector<uint8_t> rabuf(9 + test_rand() % 60);
+  std::vector<cbor_iovec_t> iov;
+  cbor_status rs = cbor_ok, cs;
+  cbor_token rt = cbor_tinvalid;
+  cbor_uint rn, n, part, got;
+  size_t pos, len;
+
+  cbdec_ctx_t r = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size());
+  TEST_CHECK(cbdec_step(&r) == cbor_ok);
+
+  for(rn = 0; rn < count; rn++) {
+    if((rs = cbdec_step(&r)) != cbor_ok) { break; }
+    if(!put(k, &r, ref.data(), rn)) {
+      rs = (r.token == cbor_tbreak)? cbor_ok : cbor_efmt;
+      break;
+    }
+  }
+  rt = r.token;
+
+  for(pos = 0; pos < data.size(); pos += len) {
+    len = 1 + test_rand() % 30;
+    if(len > data.size() - pos) { len = data.size() - pos; }
+    iov.push_back({data.data() + pos, len});
+  }
+
+  for(int mode = 0; mode < 4; mode++) {
+    source src = {&data, 0};
+    cbdec_ctx_t mem = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size());
+    cbdec_ctx_t rd = CBOR_DECODER_CTX_INITIALIZER(read, &src);
+    cbdec_ctx_t ra = CBOR_DECODER_BUF_CTX_INITIALIZER(fill, rabuf.data(), rabuf.size(), &src);
+    cbdec_ctx_t v = CBOR_DECODER_IOV_CTX_INITIALIZER(iov.data(), iov.size());
+    cbdec_ctx_t *ctx = (mode == 0)? &mem : (mode == 1)? &rd : (mode == 2)? &ra : &v;
+
+    TEST_CHECK(cbdec_step(ctx) == cbor_ok);
+
+    for(n = 0, cs = cbor_ok; n < count; n += got) {
+      part = 1 + test_rand() % (count - n);
+      cs = batch(k, ctx, out.data() + n * size, part, &got);
+      if(cs != cbor_ok || got < part) { n += got; break; }
+    }
+
+    TEST_CHECK(n == rn && cs == rs);
+    TEST_CHECK(n == 0 || std::memcmp(out.data(), ref.data(), n * size) == 0);
+    if(n < count) { TEST_CHECK(ctx->token == rt); }
+
+    // the item after the array is read as usual
+    if(rs == cbor_ok) {
+      TEST_CHECK(cbdec_step(ctx) == cbor_ok && ctx->token == cbor_tuint && ctx->value.u == 7);
+    }
+  }
+}
+
+int main(int, char**)
+{
+  // around the 64 value batches of half float conversion and the 9 byte decoder window
+  static const cbor_uint counts[] = {0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 63, 64, 65, 128, 129, 500};
+  std::vector<cbor_uint> uints;
+  std::vector<cbor_int> ints;
+  std::vector<float> floats;
+  std::vector<double> doubles;
+  uint32_t it;
+  cbor_uint count, i;
+
+  for(it = 0; it < 4000; it++) {
+    test_seed = it;
+    count = counts[it % (sizeof(counts) / sizeof(counts[0]))];
+
+    uints.resize(count);
+    ints.resize(count);
+    floats.resize(count);
+    doubles.resize(count);
+
+    for(i = 0; i < count; i++) {
+      uints[i]   = rand_uint();
+      ints[i]    = rand_int();
+      floats[i]  = static_cast<float>(rand_double());
+      doubles[i] = rand_double();
+    }
+
+    check_encode(enc_uint, uints.data(), count);
+    check_encode(enc_int, ints.data(), count);
+    check_encode(enc_float16, floats.data(), count);
+    check_encode(enc_float64, doubles.data(), count);
+
+    std::vector<uint8_t> data = make_array(count, it % 3 == 0);
+    check_decode(static_cast<kind>(it % 4), data, (data[0] == 0x9F)? count + 1 : count);
+  }
+
+  return test_result("batch");
+}
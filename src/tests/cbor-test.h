@@ -0,0 +1,149 @@
+#ifndef CBOR_TEST_H
+#define CBOR_TEST_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "cbor.h"
+
+static int test_failures = 0;
+
+#define TEST_CHECK(cond) \
+  do { \
+    if(!(cond)) { \
+      if(test_failures++ < 20) { \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      } \
+    } \
+  } while(0)
+
+// collects the encoder output
+static std::vector<uint8_t> test_out;
+
+static inline cbor_status test_write(const void *data, cbor_uint n, void*)
+{
+  const uint8_t *p = static_cast<const uint8_t*>(data);
+
+  test_out.insert(test_out.end(), p, p + n);
+  return cbor_ok;
+}
+
+// deterministic pseudo random numbers, the same on every run
+static uint32_t test_seed = 1;
+
+static inline uint32_t test_rand()
+{
+  test_seed = test_seed * 1103515245u + 12345u;
+  return test_seed >> 8;
+}
+
+// random document of every item kind, strings up to maxstr bytes
+static inline void test_doc(cbenc_ctx_t *ctx, cbor_uint maxstr, int depth)
+{
+  static const char text[] = "text \xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 0123456789abcdef";
+  static uint8_t blob[65536];
+  uint32_t i, n;
+
+  switch(test_rand() % (depth > 3? 9 : 14)) {
+  case 0: cbenc_uint(ctx, static_cast<cbor_uint>(test_rand()) << (test_rand() % 40)); break;
+  case 1: cbenc_int(ctx, -static_cast<cbor_int>(test_rand())); break;
+  case 2: cbenc_float32(ctx, test_rand() / 7.0f); break;
+  case 3: cbenc_float64(ctx, test_rand() / 3.0); break;
+  case 4: cbenc_float16(ctx, test_rand() % 100 / 4.0f); break;
+  case 5: cbenc_simple(ctx, (test_rand() % 2)? cbor_null : cbor_true); break;
+
+  case 6:
+    n = test_rand() % (maxstr + 1);
+    for(i = 0; i < n; i++) { blob[i] = static_cast<uint8_t>(i * 7 + n); }
+    cbenc_bytestr(ctx, blob, n);
+    break;
+
+  case 7:
+    // whole characters only
+    n = test_rand() % sizeof(text);
+    while(n > 0 && (text[n] & 0xC0) == 0x80) { n--; }
+    cbenc_textstr(ctx, text, n);
+    break;
+
+  case 8:
+    cbenc_bytestr_begin(ctx);
+    for(i = test_rand() % 4; i > 0; i--) { cbenc_bytestr(ctx, blob, test_rand() % (maxstr + 1)); }
+    cbenc_break(ctx);
+    break;
+
+  case 9:
+  case 10:
+    n = test_rand() % 6;
+    cbenc_array(ctx, n);
+    for(i = 0; i < n; i++) { test_doc(ctx, maxstr, depth + 1); }
+    break;
+
+  case 11:
+    cbenc_map_begin(ctx);
+    for(i = test_rand() % 4; i > 0; i--) {
+      cbenc_uint(ctx, i);
+      test_doc(ctx, maxstr, depth + 1);
+    }
+    cbenc_break(ctx);
+    break;
+
+  case 12:
+    cbenc_tag(ctx, test_rand() % 300);
+    test_doc(ctx, maxstr, depth + 1);
+    break;
+
+  default:
+    cbenc_array_begin(ctx);
+    for(i = test_rand() % 4; i > 0; i--) { test_doc(ctx, maxstr, depth + 1); }
+    cbenc_break(ctx);
+    break;
+  }
+}
+
+// decoded items as text, string data is taken with cbdec_sview or cbdec_sread by pieces
+static inline std::string test_trace(cbdec_ctx_t *ctx, bool view, cbor_uint piece)
+{
+  std::string out;
+  std::vector<uint8_t> data;
+  const void *p;
+  cbor_uint sz, u;
+  cbor_status cs;
+  char line[64];
+
+  while((cs = cbdec_step(ctx)) == cbor_ok) {
+    u = (ctx->token == cbor_tsimple)? static_cast<cbor_uint>(ctx->value.st) : ctx->value.u;
+    std::snprintf(line, sizeof(line), "%d %llx", static_cast<int>(ctx->token),
+                  static_cast<unsigned long long>(u));
+    out += line;
+
+    while((ctx->token == cbor_tbytestr || ctx->token == cbor_ttextstr) && ctx->value.u > 0) {
+      if(view) {
+        if(cbdec_sview(ctx, &p, &sz) != cbor_ok) { return out + " failed"; }
+      }
+      else {
+        sz = (ctx->value.u < piece)? ctx->value.u : piece;
+        data.resize(sz);
+        p = data.data();
+        if(cbdec_sread(ctx, data.data(), sz) != cbor_ok) { return out + " failed"; }
+      }
+
+      for(cbor_uint i = 0; i < sz; i++) {
+        std::snprintf(line, sizeof(line), " %02x", static_cast<const uint8_t*>(p)[i]);
+        out += line;
+      }
+    }
+
+    out += '\n';
+  }
+
+  std::snprintf(line, sizeof(line), "status %d\n", static_cast<int>(cs));
+  return out + line;
+}
+
+static inline int test_result(const char *name)
+{
+  std::printf("%s: %s\n", name, test_failures? "FAILED" : "passed");
+  return test_failures? 1 : 0;
+}
+
+#endif // CBOR_TEST_H
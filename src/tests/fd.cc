@@ -0,0 +1,431 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "cbor-posix.h"
+#include "cbor-test.h"
+
+// the library moves data with these, the bytes moved by each way are counted and any way can be
+// disabled as on a kernel without it
+enum { copy_range, send_file, splice_pipe, methods };
+
+static size_t moved[methods];
+static bool disabled[methods];
+
+static bool unsupported(int method)
+{
+  if(disabled[method]) { errno = ENOSYS; }
+  return disabled[method];
+}
+
+static ssize_t counted(int method, long n)
+{
+  if(n > 0) { moved[method] += n; }
+  return n;
+}
+
+extern "C" ssize_t copy_file_range(int infd, off64_t *inoff, int outfd, off64_t *outoff,
+                                   size_t len, unsigned flags)
+{
+  if(unsupported(copy_range)) { return -1; }
+  return counted(copy_range, syscall(SYS_copy_file_range, infd, inoff, outfd, outoff, len, flags));
+}
+
+extern "C" ssize_t sendfile(int outfd, int infd, off_t *off, size_t len) noexcept
+{
+  if(unsupported(send_file)) { return -1; }
+  return counted(send_file, syscall(SYS_sendfile, outfd, infd, off, len));
+}
+
+extern "C" ssize_t splice(int infd, off64_t *inoff, int outfd, off64_t *outoff, size_t len,
+                          unsigned flags)
+{
+  if(unsupported(splice_pipe)) { return -1; }
+  return counted(splice_pipe, syscall(SYS_splice, infd, inoff, outfd, outoff, len, flags));
+}
+
+// temporary file, removed when closed
+static int temp_file()
+{
+  char name[] = "/tmp/cbor-test-XXXXXX";
+  int fd = mkstemp(name);
+
+  TEST_CHECK(fd >= 0);
+  unlink(name);
+  return fd;
+}
+
+static void put(int fd, const uint8_t *data, size_t sz)
+{
+  ssize_t n;
+
+  for(; sz > 0; data += n, sz -= n) {
+    n = write(fd, data, sz);
+    if(n <= 0) { TEST_CHECK(false); return; }
+  }
+}
+
+// everything until the end of input
+static std::vector<uint8_t> take(int fd)
+{
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  ssize_t n;
+
+  while((n = read(fd, buf, sizeof(buf))) > 0) { data.insert(data.end(), buf, buf + n); }
+
+  TEST_CHECK(n == 0);
+  return data;
+}
+
+static std::vector<uint8_t> file_data(int fd)
+{
+  std::vector<uint8_t> data(lseek(fd, 0, SEEK_END));
+
+  TEST_CHECK(pread(fd, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+  return data;
+}
+
+static cbor_status fd_write(const void *data, cbor_uint sz, void *usrdata)
+{
+  put(*static_cast<int*>(usrdata), static_cast<const uint8_t*>(data), sz);
+  return cbor_ok;
+}
+
+static cbor_status fd_writev(const cbor_iovec_t *iov, size_t n, void *usrdata)
+{
+  for(size_t i = 0; i < n; i++) { fd_write(iov[i].base, iov[i].len, usrdata); }
+  return cbor_ok;
+}
+
+static cbor_status fd_read(void *data, cbor_uint sz, void *usrdata)
+{
+  uint8_t *p = static_cast<uint8_t*>(data);
+  ssize_t n;
+
+  for(; sz > 0; p += n, sz -= n) {
+    n = read(*static_cast<int*>(usrdata), p, sz);
+    if(n < 0) { return cbor_eio; }
+    if(n == 0) { return cbor_eos; }
+  }
+
+  return cbor_ok;
+}
+
+static cbor_status fd_fill(void *data, cbor_uint *sz, void *usrdata)
+{
+  ssize_t n = read(*static_cast<int*>(usrdata), data, *sz);
+
+  if(n < 0) { return cbor_eio; }
+  *sz = n;
+  return cbor_ok;
+}
+
+static void *resize(void *buf, cbor_uint sz, void*)
+{
+  return std::realloc(buf, sz);
+}
+
+// data source of each kind, the data is followed by a tail that must stay unread
+enum { src_file, src_file_pos, src_pipe, src_socket, srcs };
+
+struct source
+{
+  int fd;
+  int wr;
+  off_t off;
+  std::thread writer;
+
+  source(int kind, const std::vector<uint8_t> &data, const std::vector<uint8_t> &tail)
+    : fd(-1), wr(-1), off(-1)
+  {
+    int fds[2];
+
+    if(kind == src_file || kind == src_file_pos) {
+      std::vector<uint8_t> head(1 + data.size() % 13, 0xAA);
+
+      fd = temp_file();
+      put(fd, head.data(), head.size());
+      put(fd, data.data(), data.size());
+      put(fd, tail.data(), tail.size());
+
+      // data at the offset, or at the file position
+      TEST_CHECK(lseek(fd, (kind == src_file)? 0 : head.size(), SEEK_SET) >= 0);
+      if(kind == src_file) { off = head.size(); }
+      return;
+    }
+
+    TEST_CHECK(((kind == src_pipe)? pipe(fds) : socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) == 0);
+    fd = fds[0];
+    wr = fds[1];
+
+    // written while read, the data does not fit a pipe buffer
+    writer = std::thread([this, &data, &tail]() {
+      put(wr, data.data(), data.size());
+      put(wr, tail.data(), tail.size());
+      close(wr);
+    });
+  }
+
+  // what is left after sz bytes of data were taken, reading at the offset keeps the position
+  std::vector<uint8_t> rest(size_t sz)
+  {
+    std::vector<uint8_t> r;
+
+    if(wr < 0) {
+      off_t pos = lseek(fd, 0, SEEK_CUR);
+
+      if(off >= 0) { TEST_CHECK(pos == 0); }
+      r = file_data(fd);
+      r.erase(r.begin(), r.begin() + ((off >= 0)? off + sz : pos));
+    }
+    else {
+      r = take(fd);
+      writer.join();
+    }
+
+    close(fd);
+    return r;
+  }
+};
+
+// output file, or a pipe read by a thread
+struct sink
+{
+  int fd;
+  int rd;
+  std::vector<uint8_t> out;
+  std::thread reader;
+
+  explicit sink(bool to_pipe) : fd(-1), rd(-1)
+  {
+    int fds[2];
+
+    if(!to_pipe) {
+      fd = temp_file();
+      return;
+    }
+
+    TEST_CHECK(pipe(fds) == 0);
+    rd = fds[0];
+    fd = fds[1];
+    reader = std::thread([this]() { out = take(rd); });
+  }
+
+  std::vector<uint8_t> data()
+  {
+    if(rd < 0) { out = file_data(fd); }
+    close(fd);
+
+    if(rd >= 0) {
+      reader.join();
+      close(rd);
+    }
+
+    return out;
+  }
+};
+
+// number, byte string, number, optionally in an array
+static std::vector<uint8_t> reference(const std::vector<uint8_t> &data, bool open)
+{
+  std::vector<uint8_t> big(data.size() + 64);
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, big.data(), big.size(), nullptr);
+  cbor_uint mark;
+
+  test_out.clear();
+  cbenc_begin(&w);
+  if(open) { cbenc_array_open(&w, &mark); }
+  cbenc_uint(&w, 1);
+  cbenc_bytestr(&w, data.data(), data.size());
+  cbenc_uint(&w, 7);
+  if(open) { cbenc_close(&w, mark, 0); }
+  cbenc_end(&w);
+
+  return test_out;
+}
+
+static cbor_status encode(cbenc_ctx_t *ctx, int dstfd, source &src, cbor_uint sz, bool open)
+{
+  cbor_status cs;
+  cbor_uint mark;
+
+  cbenc_begin(ctx);
+  if(open && (cs = cbenc_array_open(ctx, &mark)) != cbor_ok) { return cs; }
+
+  cbenc_uint(ctx, 1);
+  if((cs = cbenc_bytestr_fd(ctx, dstfd, src.fd, src.off, sz)) != cbor_ok) { return cs; }
+  cbenc_uint(ctx, 7);
+
+  if(open && (cs = cbenc_close(ctx, mark, 0)) != cbor_ok) { return cs; }
+  return cbenc_end(ctx);
+}
+
+// the way that moved data from this source to this destination, methods for the buffer
+static int expected_method(int src, bool to_pipe)
+{
+  int m;
+
+  for(m = 0; m < methods; m++) {
+    if(disabled[m]) { continue; }
+
+    switch(m) {
+    case copy_range: if(src <= src_file_pos && !to_pipe) { return m; } break;
+    case send_file:  if(src <= src_file_pos) { return m; } break;
+    default:         if(src == src_pipe || to_pipe) { return m; } break;
+    }
+  }
+
+  return m;
+}
+
+static void check_moved(int method, size_t sz)
+{
+  // newer kernels send from a pipe as well, before splice is tried
+  if(method > send_file && !disabled[send_file] && moved[send_file] > 0) { method = send_file; }
+
+  for(int m = 0; m < methods; m++) { TEST_CHECK(moved[m] == ((m == method)? sz : 0)); }
+}
+
+// encoded to a file or pipe and decoded from there, the string data passed between descriptors
+static void check_transfer(uint32_t it, const std::vector<uint8_t> &data, int src, bool to_pipe)
+{
+  static const cbor_uint bufs[] = {CBOR_ENCODER_MIN_BUFFER_SIZE, 64, 5000};
+  std::vector<uint8_t> tail(1 + it % 5, 0xF7), ref = reference(data, false), out, buf, enc;
+  std::vector<cbor_iovec_t> iov(4);
+  bool vectored = it % 2;
+  int method = expected_method(src, to_pipe);
+
+  buf.assign(bufs[it % 3], 0);
+  std::memset(moved, 0, sizeof(moved));
+
+  {
+    source s(src, data, tail);
+    sink d(to_pipe);
+    cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(fd_write, buf.data(), buf.size(), &d.fd);
+    cbenc_ctx_t v = CBOR_ENCODER_IOV_CTX_INITIALIZER(fd_writev, buf.data(), buf.size(), iov.data(),
+                                                     iov.size(), &d.fd);
+
+    TEST_CHECK(encode(vectored? &v : &w, d.fd, s, data.size(), false) == cbor_ok);
+    TEST_CHECK(s.rest(data.size()) == tail);
+    enc = d.data();
+  }
+
+  TEST_CHECK(enc == ref);
+  check_moved(method, data.size());
+
+  // decoded from a pipe to a pipe, or from a file to a file, the next item is read after it
+  {
+    source s(to_pipe? src_file_pos : src_pipe, enc, tail);
+    sink d(!to_pipe);
+    cbdec_ctx_t r = CBOR_DECODER_CTX_INITIALIZER(fd_read, &s.fd);
+    cbdec_ctx_t b = CBOR_DECODER_BUF_CTX_INITIALIZER(fd_fill, buf.data(), buf.size(), &s.fd);
+    cbdec_ctx_t *ctx = vectored? &b : &r;
+
+    std::memset(moved, 0, sizeof(moved));
+    TEST_CHECK(cbdec_step(ctx) == cbor_ok && ctx->token == cbor_tuint && ctx->value.u == 1);
+    TEST_CHECK(cbdec_step(ctx) == cbor_ok && ctx->token == cbor_tbytestr);
+    TEST_CHECK(ctx->value.u == data.size());
+    TEST_CHECK(cbdec_sread_fd(ctx, s.fd, d.fd) == cbor_ok);
+    TEST_CHECK(cbdec_step(ctx) == cbor_ok && ctx->token == cbor_tuint && ctx->value.u == 7);
+
+    // read-ahead takes a part of the data and the tail, the read callback only what it decodes
+    if(!vectored) {
+      TEST_CHECK(s.rest(enc.size()) == tail);
+      check_moved(expected_method(to_pipe? src_file_pos : src_pipe, !to_pipe), data.size());
+    }
+    else {
+      s.rest(enc.size());
+    }
+
+    out = d.data();
+  }
+
+  TEST_CHECK(out == data);
+}
+
+// data that stays in the encoder buffer is read there, measure mode leaves the source unread
+static void check_held(uint32_t it, const std::vector<uint8_t> &data, int src)
+{
+  std::vector<uint8_t> tail(1 + it % 5, 0xF7), ref = reference(data, true), buf(ref.size() + 8);
+  cbenc_ctx_t m = CBOR_ENCODER_MEASURE_CTX_INITIALIZER;
+  void *mem;
+  cbor_uint sz;
+
+  std::memset(moved, 0, sizeof(moved));
+
+  // the buffer holds the container with room for its longest header
+  {
+    source s(src, data, tail);
+    cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+    test_out.clear();
+    TEST_CHECK(encode(&w, -1, s, data.size(), true) == cbor_ok && test_out == ref);
+    TEST_CHECK(s.rest(data.size()) == tail);
+  }
+
+  {
+    source s(src, data, tail);
+    cbenc_ctx_t g = CBOR_ENCODER_MEM_CTX_INITIALIZER(resize, it % 100, nullptr);
+    TEST_CHECK(encode(&g, -1, s, data.size(), it % 2) == cbor_ok);
+    TEST_CHECK(s.rest(data.size()) == tail);
+    cbenc_release(&g, &mem, &sz);
+    TEST_CHECK(std::vector<uint8_t>(static_cast<uint8_t*>(mem), static_cast<uint8_t*>(mem) + sz) ==
+               reference(data, it % 2));
+    std::free(mem);
+  }
+
+  {
+    source s(src, data, tail);
+    std::vector<uint8_t> all(data);
+    all.insert(all.end(), tail.begin(), tail.end());
+    TEST_CHECK(encode(&m, -1, s, data.size(), it % 2) == cbor_ok);
+    TEST_CHECK(cbenc_size(&m) == reference(data, it % 2).size());
+    TEST_CHECK(s.rest(0) == all);
+  }
+
+  check_moved(methods, 0);
+}
+
+// source ends before the data
+static void check_short(const std::vector<uint8_t> &data, int src, bool to_pipe)
+{
+  std::vector<uint8_t> buf(64), none;
+  source s(src, data, none);
+  sink d(to_pipe);
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(fd_write, buf.data(), buf.size(), &d.fd);
+
+  TEST_CHECK(encode(&w, d.fd, s, data.size() + 1 + data.size() % 100, false) == cbor_eos);
+  TEST_CHECK(s.rest(data.size()).empty());
+  d.data();
+}
+
+int main(int, char**)
+{
+  static const size_t sizes[] = {0, 1, 100, 16383, 16384, 16385, 70000, 1 << 20};
+  std::vector<uint8_t> data;
+  uint32_t it;
+  int src, mask;
+
+  for(it = 0; it < 8 * srcs * 2; it++) {
+    data.resize(sizes[it % 8]);
+    for(size_t i = 0; i < data.size(); i++) { data[i] = static_cast<uint8_t>(i * 7 + it + i / 3); }
+    src = it / 8 % srcs;
+
+    // every way switched off in turn, the buffer takes over
+    for(mask = 0; mask < 1 << methods; mask++) {
+      for(int m = 0; m < methods; m++) { disabled[m] = mask & (1 << m); }
+      check_transfer(it + mask, data, src, it / (8 * srcs));
+      if(data.size() > 0) { check_short(data, src, it / (8 * srcs)); }
+    }
+
+    std::memset(disabled, 0, sizeof(disabled));
+    check_held(it, data, src);
+  }
+
+  return test_result("fd");
+}
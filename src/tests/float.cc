@@ -0,0 +1,121 @@
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include "cbor-test.h"
+
+static void put_be(std::vector<uint8_t> &out, uint8_t head, uint64_t bits, int size)
+{
+  out.push_back(head);
+  while(size--) { out.push_back(static_cast<uint8_t>(bits >> size * 8)); }
+}
+
+// preferred serialization by trial conversion: the shortest width that converts back exactly
+static std::vector<uint8_t> reference(double val)
+{
+  std::vector<uint8_t> out;
+  uint64_t bits, m;
+  uint32_t fbits;
+  uint16_t half;
+  float f, back;
+
+  std::memcpy(&bits, &val, sizeof(bits));
+
+#ifdef CBOR_ENABLE_FLOAT_ZERO_AS_UINT
+  if(bits == 0) { out.push_back(0); return out; }
+#endif
+
+  if(std::isnan(val)) {
+    // payload is kept, so it must fit into the narrower mantissa
+    m = bits & 0xFFFFFFFFFFFFFull;
+
+    if((m & ((1ull << 42) - 1)) == 0) {
+      put_be(out, 0xF9, (bits >> 48 & 0x8000) | 0x7C00 | m >> 42, 2);
+    }
+    else if((m & ((1ull << 29) - 1)) == 0) {
+      put_be(out, 0xFA, (bits >> 32 & 0x80000000u) | 0x7F800000u | m >> 29, 4);
+    }
+    else {
+      put_be(out, 0xFB, bits, 8);
+    }
+
+    return out;
+  }
+
+  if(std::fabs(val) > FLT_MAX && !std::isinf(val)) { put_be(out, 0xFB, bits, 8); return out; }
+
+  f = static_cast<float>(val);
+  if(static_cast<double>(f) != val) { put_be(out, 0xFB, bits, 8); return out; }
+
+  std::memcpy(&fbits, &f, sizeof(fbits));
+  cbor_float16_encode(&half, &f, 1);
+  cbor_float16_decode(&back, &half, 1);
+
+  if(std::memcmp(&back, &f, sizeof(f)) == 0) { put_be(out, 0xF9, half, 2); }
+  else { put_be(out, 0xFA, fbits, 4); }
+
+  return out;
+}
+
+static void check_value(double val)
+{
+  uint8_t buf[16];
+  cbenc_ctx_t ctx = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf, sizeof(buf), nullptr);
+
+  test_out.clear();
+  cbenc_begin(&ctx);
+  cbenc_float(&ctx, val);
+  cbenc_end(&ctx);
+
+  TEST_CHECK(test_out == reference(val));
+
+  // and it decodes to the same value
+  cbdec_ctx_t dec = CBOR_DECODER_MEM_CTX_INITIALIZER(test_out.data(), test_out.size());
+  TEST_CHECK(cbdec_step(&dec) == cbor_ok);
+
+  if(!std::isnan(val) && dec.token == cbor_tfloat32) {
+    TEST_CHECK(static_cast<double>(dec.value.f32) == val);
+    TEST_CHECK(std::signbit(dec.value.f32) == std::signbit(val));
+  }
+  else if(!std::isnan(val)) {
+    TEST_CHECK(dec.token == cbor_tfloat64 && std::memcmp(&dec.value.f64, &val, sizeof(val)) == 0);
+  }
+}
+
+static double bits_double(uint64_t bits)
+{
+  double d;
+
+  std::memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+int main(int, char**)
+{
+  static const double known[] = {
+    0.0, -0.0, 1.0, -1.5, 0.1, 1.0 / 3.0, 65504.0, 65520.0, 100000.0, 5.960464477539063e-8,
+    1e-8, 1.401298464324817e-45, 4.9e-324, FLT_MAX, -DBL_MAX, HUGE_VAL, -HUGE_VAL, NAN
+  };
+  static const uint64_t nans[] = {
+    0x7FF8000000000000ull, 0xFFF8000000000000ull, 0x7FF0040000000000ull, 0x7FF0000020000000ull,
+    0x7FF0000010000000ull, 0xFFF0020000000000ull, 0x7FF0000000000001ull, 0x7FFFFFFFFFFFFFFFull
+  };
+  uint16_t half;
+  float f;
+  uint32_t i;
+
+  for(double val : known) { check_value(val); }
+  for(uint64_t bits : nans) { check_value(bits_double(bits)); }
+
+  for(i = 0; i < 65536; i++) {
+    // every half float, floats and doubles near the narrower ranges, random doubles
+    half = static_cast<uint16_t>(i);
+    cbor_float16_decode(&f, &half, 1);
+    check_value(f);
+
+    check_value(f * (1.0 + 1.0 / (1 << 20)));
+    check_value(static_cast<double>(f) + 1e-300);
+    check_value(bits_double(static_cast<uint64_t>(test_rand()) << 40 | test_rand()));
+  }
+
+  return test_result("float");
+}
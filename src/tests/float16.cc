@@ -0,0 +1,99 @@
+#include <cstring>
+#include "cbor-test.h"
+
+static uint32_t float_bits(float f)
+{
+  uint32_t u;
+
+  std::memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static float bits_float(uint32_t u)
+{
+  float f;
+
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+// batches of 8 and more use F16C where available, single values the portable code
+static void check_decode()
+{
+  std::vector<uint16_t> half(65536);
+  std::vector<float> batch(65536);
+  float single;
+  uint16_t back;
+  uint32_t i;
+
+  for(i = 0; i < 65536; i++) { half[i] = static_cast<uint16_t>(i); }
+
+  cbor_float16_decode(batch.data(), half.data(), 65536);
+
+  for(i = 0; i < 65536; i++) {
+    cbor_float16_decode(&single, &half[i], 1);
+    TEST_CHECK(float_bits(batch[i]) == float_bits(single));
+
+    // every half float (but NaN with a signaling payload) survives a round trip
+    cbor_float16_encode(&back, &single, 1);
+    if((i & 0x7E00) != 0x7C00 || (i & 0x3FF) == 0) { TEST_CHECK(back == i); }
+  }
+}
+
+static void check_encode()
+{
+  std::vector<float> vals;
+  std::vector<uint16_t> batch;
+  uint16_t single;
+  uint32_t e, i, m;
+
+  // exponents around the half float range, with mantissas that round every way
+  for(e = 90; e < 160; e++) {
+    for(m = 0; m < 0x2000; m += 0x3FF) {
+      vals.push_back(bits_float(e << 23 | m));
+      vals.push_back(bits_float(e << 23 | 0x7FE000 | m));
+      vals.push_back(bits_float(0x80000000u | e << 23 | (test_rand() & 0x7FFFFF)));
+    }
+
+    vals.push_back(bits_float(e << 23 | 0x1000));
+    vals.push_back(bits_float(e << 23 | 0x3000));
+  }
+
+  // zeros, subnormals, infinities and NaN
+  for(i = 0; i < 4; i++) {
+    vals.push_back(bits_float(i));
+    vals.push_back(bits_float(0x80000000u | 0x7F800000u | i));
+    vals.push_back(bits_float(0x7FC00000u | i << 13));
+  }
+
+  batch.resize(vals.size());
+  cbor_float16_encode(batch.data(), vals.data(), vals.size());
+
+  for(i = 0; i < vals.size(); i++) {
+    cbor_float16_encode(&single, &vals[i], 1);
+    TEST_CHECK(batch[i] == single);
+  }
+}
+
+static void check_values()
+{
+  static const struct { float f; uint16_t h; } known[] = {
+    {1.0f, 0x3C00}, {-2.0f, 0xC000}, {65504.0f, 0x7BFF}, {65520.0f, 0x7C00},
+    {5.9604645e-8f, 0x0001}, {2.9802322e-8f, 0x0000}, {0.1f, 0x2E66}, {0.0f, 0x0000}
+  };
+  uint16_t h;
+
+  for(const auto &k : known) {
+    cbor_float16_encode(&h, &k.f, 1);
+    TEST_CHECK(h == k.h);
+  }
+}
+
+int main(int, char**)
+{
+  check_decode();
+  check_encode();
+  check_values();
+
+  return test_result("float16");
+}
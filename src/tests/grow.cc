@@ -0,0 +1,166 @@
+#include <cstdlib>
+#include <cstring>
+#include "cbor-test.h"
+
+static uint8_t blob[20000];
+
+// realloc counting calls, fails from the given call on
+struct heap
+{
+  uint32_t calls;
+  uint32_t fail_at;
+  cbor_uint last;
+};
+
+static void *resize(void *buf, cbor_uint sz, void *usrdata)
+{
+  heap *h = static_cast<heap*>(usrdata);
+
+  if(++h->calls >= h->fail_at) { return nullptr; }
+
+  TEST_CHECK(sz > h->last || buf == nullptr);
+  h->last = sz;
+  return std::realloc(buf, sz);
+}
+
+// random items with the status of the first failed call
+static cbor_status encode(cbenc_ctx_t *ctx, int depth)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint mark, i, n = test_rand() % (depth? 6 : 30);
+
+  while(n-- > 0 && cs == cbor_ok) {
+    switch(test_rand() % ((depth > 2)? 7 : 9)) {
+    case 0: cs = cbenc_uint(ctx, static_cast<cbor_uint>(test_rand()) << test_rand() % 40); break;
+    case 1: cs = cbenc_int(ctx, -static_cast<cbor_int>(test_rand())); break;
+    case 2: cs = cbenc_float64(ctx, test_rand() / 3.0); break;
+    case 3: cs = cbenc_cstring(ctx, "text \xC3\xA9"); break;
+
+    case 4:
+      // strings larger than the buffer grows by
+      cs = cbenc_bytestr(ctx, blob, test_rand() % ((test_rand() % 8)? 50 : sizeof(blob)));
+      break;
+
+    case 5:
+      cs = cbenc_reserve(ctx, 11 + test_rand() % 600);
+      if(cs != cbor_ok) { break; }
+
+      cbenc_put_array(ctx, 2);
+      cbenc_put_uint(ctx, test_rand());
+      cbenc_put_simple(ctx, cbor_false);
+      break;
+
+    case 6:
+      cs = cbenc_map_begin(ctx);
+      for(i = test_rand() % 3; i > 0 && cs == cbor_ok; i--) {
+        cs = cbenc_uint(ctx, i);
+        if(cs == cbor_ok) { cs = cbenc_bytestr(ctx, blob, test_rand() % 100); }
+      }
+      if(cs == cbor_ok) { cs = cbenc_break(ctx); }
+      break;
+
+    case 7:
+      cs = cbenc_array(ctx, 3);
+      for(i = 0; i < 3 && cs == cbor_ok; i++) { cs = encode(ctx, depth + 3); }
+      break;
+
+    default:
+      // containers stay in the buffer until closed
+      cs = cbenc_array_open(ctx, &mark);
+      if(cs == cbor_ok) { cs = cbenc_uint(ctx, 1); }
+      if(cs == cbor_ok) { cs = encode(ctx, depth + 1); }
+      if(cs == cbor_ok) { cs = cbenc_close(ctx, mark, 1 + test_rand() % 3); }
+      break;
+    }
+  }
+
+  return cs;
+}
+
+// one message in the write mode, as reference
+static std::vector<uint8_t> reference(uint32_t seed)
+{
+  static std::vector<uint8_t> big(1 << 24);
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, big.data(), big.size(), nullptr);
+
+  test_seed = seed;
+  test_out.clear();
+  cbenc_begin(&w);
+  TEST_CHECK(encode(&w, 0) == cbor_ok && cbenc_end(&w) == cbor_ok);
+
+  return test_out;
+}
+
+static cbor_uint log2_ceil(cbor_uint n)
+{
+  cbor_uint k = 0;
+
+  while((static_cast<cbor_uint>(1) << k) < n) { k++; }
+  return k;
+}
+
+int main(int, char**)
+{
+  static const cbor_uint reserves[] = {0, 1, CBOR_ENCODER_MIN_BUFFER_SIZE, 10, 64, 4096};
+  std::vector<uint8_t> ref;
+  uint32_t it, calls;
+  cbor_uint reserve, sz, sz2;
+  void *data, *data2;
+  cbor_status cs;
+
+  for(uint32_t i = 0; i < sizeof(blob); i++) { blob[i] = static_cast<uint8_t>(i * 13); }
+
+  for(it = 0; it < 3000; it++) {
+    heap h = {0, ~0u, 0};
+    reserve = reserves[it % (sizeof(reserves) / sizeof(reserves[0]))];
+    ref = reference(it);
+
+    cbenc_ctx_t g = CBOR_ENCODER_MEM_CTX_INITIALIZER(resize, reserve, &h);
+
+    test_seed = it;
+    TEST_CHECK(cbenc_begin(&g) == cbor_ok);
+    TEST_CHECK(encode(&g, 0) == cbor_ok && cbenc_end(&g) == cbor_ok);
+    TEST_CHECK(cbenc_size(&g) == ref.size());
+
+    // the buffer at least doubles on every growth
+    calls = h.calls;
+    TEST_CHECK(calls <= 2 + log2_ceil(ref.size() + 1));
+
+    // without release the buffer is reused as it is
+    test_seed = it;
+    TEST_CHECK(cbenc_begin(&g) == cbor_ok);
+    TEST_CHECK(encode(&g, 0) == cbor_ok && cbenc_end(&g) == cbor_ok);
+    TEST_CHECK(h.calls == calls);
+
+    TEST_CHECK(cbenc_release(&g, &data2, &sz2) == cbor_ok);
+    TEST_CHECK(sz2 == ref.size() && (sz2 == 0 || std::memcmp(data2, ref.data(), sz2) == 0));
+
+    // after release the next buffer is allocated of the size the last one grew to
+    test_seed = it;
+    h.last = 0;
+    TEST_CHECK(cbenc_begin(&g) == cbor_ok && h.calls == calls + 1);
+    TEST_CHECK(encode(&g, 0) == cbor_ok && cbenc_end(&g) == cbor_ok && h.calls == calls + 1);
+    TEST_CHECK(cbenc_release(&g, &data, &sz) == cbor_ok && data != data2);
+    TEST_CHECK(sz == ref.size() && (sz == 0 || std::memcmp(data, ref.data(), sz) == 0));
+
+    std::free(data);
+    std::free(data2);
+
+    // allocation failure at any growth is cbor_enomem, the caller still frees the buffer
+    h = {0, 1 + test_rand() % (calls + 1), 0};
+    cbenc_ctx_t f = CBOR_ENCODER_MEM_CTX_INITIALIZER(resize, reserve, &h);
+
+    cs = cbenc_begin(&f);
+    test_seed = it;
+    if(cs == cbor_ok) { cs = encode(&f, 0); }
+    if(cs == cbor_ok) { cs = cbenc_end(&f); }
+
+    TEST_CHECK(cs == ((h.fail_at <= calls)? cbor_enomem : cbor_ok));
+    TEST_CHECK(cbenc_release(&f, &data, &sz) == cbor_ok);
+    if(cs != cbor_ok) { TEST_CHECK(sz <= ref.size() + 8 && (data != nullptr || sz == 0)); }
+    else { TEST_CHECK(sz == ref.size() && (sz == 0 || std::memcmp(data, ref.data(), sz) == 0)); }
+    std::free(data);
+  }
+
+  return test_result("grow");
+}
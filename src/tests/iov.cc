@@ -0,0 +1,87 @@
+#include "cbor-test.h"
+
+// splits the data into segments of random size, empty and one byte segments included
+static std::vector<cbor_iovec_t> split(const std::vector<uint8_t> &data)
+{
+  std::vector<cbor_iovec_t> iov;
+  size_t pos = 0, len;
+
+  while(pos < data.size() || test_rand() % 4 == 0) {
+    switch(test_rand() % 5) {
+    case 0:  len = 0; break;
+    case 1:  len = 1; break;
+    case 2:  len = 1 + test_rand() % 9; break;
+    default: len = test_rand() % 3000; break;
+    }
+
+    if(len > data.size() - pos) { len = data.size() - pos; }
+
+    iov.push_back({len? data.data() + pos : nullptr, len});
+    pos += len;
+  }
+
+  return iov;
+}
+
+// number of items at the top level, skipping containers and strings
+static size_t count(cbdec_ctx_t *ctx)
+{
+  size_t n = 0;
+  cbor_status cs;
+
+  while((cs = cbdec_step(ctx)) == cbor_ok) {
+    TEST_CHECK(cbdec_skip(ctx) == cbor_ok);
+    n++;
+  }
+
+  TEST_CHECK(cs == cbor_eos);
+  return n;
+}
+
+int main(int, char**)
+{
+  std::vector<uint8_t> buf(4096);
+  std::vector<cbor_iovec_t> iov;
+  std::string ref;
+  uint32_t it;
+  size_t n;
+
+  for(it = 0; it < 3000; it++) {
+    cbenc_ctx_t enc = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+
+    test_seed = it;
+    test_out.clear();
+    cbenc_begin(&enc);
+    for(int k = test_rand() % 8; k >= 0; k--) { test_doc(&enc, (it % 4)? 40 : 3000, 0); }
+    cbenc_end(&enc);
+
+    cbdec_ctx_t mem = CBOR_DECODER_MEM_CTX_INITIALIZER(test_out.data(), test_out.size());
+    ref = test_trace(&mem, true, 0);
+    cbdec_ctx_t memc = CBOR_DECODER_MEM_CTX_INITIALIZER(test_out.data(), test_out.size());
+    n = count(&memc);
+
+    // string views come by one piece per segment, reads of any size cross segments
+    iov = split(test_out);
+    cbdec_ctx_t v = CBOR_DECODER_IOV_CTX_INITIALIZER(iov.data(), iov.size());
+    TEST_CHECK(test_trace(&v, true, 0) == ref);
+
+    cbdec_ctx_t r = CBOR_DECODER_IOV_CTX_INITIALIZER(iov.data(), iov.size());
+    TEST_CHECK(test_trace(&r, false, 1 + it % 700) == ref);
+
+    cbdec_ctx_t s = CBOR_DECODER_IOV_CTX_INITIALIZER(iov.data(), iov.size());
+    TEST_CHECK(count(&s) == n);
+
+    // truncated chain ends as truncated memory does, byte by byte for strings
+    if(!test_out.empty()) {
+      test_out.pop_back();
+      cbdec_ctx_t tm = CBOR_DECODER_MEM_CTX_INITIALIZER(test_out.data(), test_out.size());
+      ref = test_trace(&tm, false, 1);
+
+      iov = split(test_out);
+      cbdec_ctx_t t = CBOR_DECODER_IOV_CTX_INITIALIZER(iov.data(), iov.size());
+      TEST_CHECK(test_trace(&t, false, 1) == ref);
+    }
+  }
+
+  return test_result("iov");
+}
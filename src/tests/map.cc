@@ -0,0 +1,233 @@
+#include <cstring>
+#include "cbor-test.h"
+
+static const char *names[] = {
+  "a", "bb", "id", "name", "key \xC3\xA9", "a longer key, not contiguous in a small buffer", ""
+};
+static const size_t nnames = sizeof(names) / sizeof(names[0]);
+
+// map entry as encoded: text or uint key, value is a tag followed by a random item
+struct entry
+{
+  int key; // index into names, -1 for uint key
+  cbor_uint tag;
+  size_t start, end; // encoded value position
+};
+
+static std::vector<entry> make_map(cbenc_ctx_t *ctx)
+{
+  std::vector<entry> entries(test_rand() % 12);
+  bool var = test_rand() % 2;
+
+  if(var) { cbenc_map_begin(ctx); }
+  else { cbenc_map(ctx, entries.size()); }
+
+  for(size_t i = 0; i < entries.size(); i++) {
+    entry &e = entries[i];
+
+    e.key = (test_rand() % 8)? static_cast<int>(test_rand() % nnames) : -1;
+    e.tag = 1000 + i;
+
+    if(e.key < 0) { cbenc_uint(ctx, 5); }
+    else { cbenc_cstring(ctx, names[e.key]); }
+
+    e.start = cbenc_size(ctx);
+    cbenc_tag(ctx, e.tag);
+    test_doc(ctx, 100, 2);
+    e.end = cbenc_size(ctx);
+  }
+
+  if(var) { cbenc_break(ctx); }
+
+  // the item after the map
+  cbenc_uint(ctx, 7777);
+
+  return entries;
+}
+
+struct source
+{
+  const std::vector<uint8_t> *data;
+  size_t pos;
+};
+
+static cbor_status read(void *data, cbor_uint sz, void *usrdata)
+{
+  source *src = static_cast<source*>(usrdata);
+
+  if(src->data->size() - src->pos < sz) { return cbor_eos; }
+
+  std::memcpy(data, src->data->data() + src->pos, sz);
+  src->pos += sz;
+  return cbor_ok;
+}
+
+static cbor_status fill(void *data, cbor_uint *sz, void *usrdata)
+{
+  source *src = static_cast<source*>(usrdata);
+  cbor_uint n = src->data->size() - src->pos;
+
+  if(n > *sz) { n = *sz; }
+
+  std::memcpy(data, src->data->data() + src->pos, n);
+  src->pos += n;
+  *sz = n;
+  return cbor_ok;
+}
+
+// decoder over the data: memory, read callback, small read-ahead buffer or segments
+struct decoder
+{
+  source src;
+  uint8_t buf[16];
+  cbor_iovec_t iov[3];
+  cbdec_ctx_t ctx;
+
+  decoder(const std::vector<uint8_t> &data, int mode)
+  {
+    size_t a = data.size() / 3, b = data.size() * 2 / 3;
+
+    src = {&data, 0};
+
+    switch(mode) {
+    case 0: ctx = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size()); break;
+    case 1: ctx = CBOR_DECODER_CTX_INITIALIZER(read, &src); break;
+    case 2: ctx = CBOR_DECODER_BUF_CTX_INITIALIZER(fill, buf, sizeof(buf), &src); break;
+
+    default:
+      iov[0] = {data.data(), a};
+      iov[1] = {data.data() + a, b - a};
+      iov[2] = {data.data() + b, data.size() - b};
+      ctx = CBOR_DECODER_IOV_CTX_INITIALIZER(iov, 3);
+      break;
+    }
+  }
+};
+
+static int first(const std::vector<entry> &entries, size_t name)
+{
+  for(size_t i = 0; i < entries.size(); i++) {
+    if(entries[i].key == static_cast<int>(name)) { return static_cast<int>(i); }
+  }
+
+  return -1;
+}
+
+static void check(const std::vector<uint8_t> &data, const std::vector<entry> &entries)
+{
+  cbdec_key_t keys[nnames + 1];
+  size_t i;
+  int mode, idx;
+
+  for(mode = 0; mode < 4; mode++) {
+    // every key and a missing one
+    for(i = 0; i <= nnames; i++) {
+      const char *key = (i < nnames)? names[i] : "missing";
+      decoder dec(data, mode);
+
+      idx = (i < nnames)? first(entries, i) : -1;
+
+      TEST_CHECK(cbdec_step(&dec.ctx) == cbor_ok);
+      cbor_status cs = cbdec_map_find(&dec.ctx, key, std::strlen(key));
+
+      if(idx < 0) {
+        TEST_CHECK(cs == cbor_eos);
+        TEST_CHECK(cbdec_step(&dec.ctx) == cbor_ok && dec.ctx.value.u == 7777);
+      }
+      else {
+        TEST_CHECK(cs == cbor_ok);
+        TEST_CHECK(dec.ctx.token == cbor_ttag && dec.ctx.value.u == entries[idx].tag);
+      }
+    }
+
+    // all keys in one pass
+    for(i = 0; i <= nnames; i++) {
+      keys[i].key = (i < nnames)? names[i] : "missing";
+      keys[i].len = std::strlen(keys[i].key);
+    }
+    cbdec_map_keys_init(keys, nnames + 1);
+
+    decoder dec(data, mode);
+
+    TEST_CHECK(cbdec_step(&dec.ctx) == cbor_ok);
+    TEST_CHECK(cbdec_map_keys(&dec.ctx, keys, nnames + 1) == cbor_ok);
+
+    for(i = 0; i <= nnames; i++) {
+      idx = (i < nnames)? first(entries, i) : -1;
+
+      if(idx < 0) {
+        TEST_CHECK(keys[i].token == cbor_tinvalid && keys[i].data == nullptr);
+        continue;
+      }
+
+      TEST_CHECK(keys[i].token == cbor_ttag && keys[i].value.u == entries[idx].tag);
+
+      if(mode == 0) {
+        const uint8_t *p = static_cast<const uint8_t*>(keys[i].data);
+        TEST_CHECK(p == data.data() + entries[idx].start);
+        TEST_CHECK(keys[i].sz == entries[idx].end - entries[idx].start);
+      }
+    }
+
+    // the map is read through
+    TEST_CHECK(cbdec_step(&dec.ctx) == cbor_ok && dec.ctx.value.u == 7777);
+  }
+}
+
+static void check_malformed()
+{
+  static const struct { const char *hex; const char *key; cbor_status cs; } cases[] = {
+    {"bf6161ff", "a", cbor_efmt},             // key without value
+    {"bf6161ff", "b", cbor_efmt},
+    {"bf6161016162ff", "b", cbor_efmt},       // odd number of items after a whole entry
+    {"bf6161016162ff", "zz", cbor_efmt},
+    {"bf6161ff6162020304", "b", cbor_efmt},   // break in place of the value, more items follow
+    {"a16161ff", "a", cbor_efmt},             // break in a map with fixed length
+    {"a1ff01", "a", cbor_efmt},
+    {"a201020361", "a", cbor_eos}             // truncated
+  };
+  std::vector<uint8_t> data;
+  cbdec_key_t keys[2] = {CBOR_MAP_KEY_INITIALIZER("a"), CBOR_MAP_KEY_INITIALIZER("b")};
+
+  cbdec_map_keys_init(keys, 2);
+
+  for(const auto &c : cases) {
+    data.clear();
+    for(size_t i = 0; c.hex[i]; i += 2) {
+      data.push_back(static_cast<uint8_t>(std::stoul(std::string(c.hex + i, 2), nullptr, 16)));
+    }
+
+    for(int mode = 0; mode < 4; mode++) {
+      decoder find(data, mode), all(data, mode);
+
+      TEST_CHECK(cbdec_step(&find.ctx) == cbor_ok);
+      TEST_CHECK(cbdec_map_find(&find.ctx, c.key, std::strlen(c.key)) == c.cs);
+
+      TEST_CHECK(cbdec_step(&all.ctx) == cbor_ok);
+      TEST_CHECK(cbdec_map_keys(&all.ctx, keys, 2) == c.cs);
+    }
+  }
+}
+
+int main(int, char**)
+{
+  uint8_t buf[4096];
+  uint32_t it;
+
+  for(it = 0; it < 3000; it++) {
+    cbenc_ctx_t enc = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf, sizeof(buf), nullptr);
+    std::vector<entry> entries;
+
+    test_seed = it;
+    test_out.clear();
+    cbenc_begin(&enc);
+    entries = make_map(&enc);
+    cbenc_end(&enc);
+
+    check(test_out, entries);
+  }
+
+  check_malformed();
+
+  return test_result("map");
+}
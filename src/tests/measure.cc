@@ -0,0 +1,128 @@
+#include <cstdlib>
+#include <cstring>
+#include "cbor-test.h"
+
+static uint8_t blob[3000];
+static cbor_uint uints[64];
+static double doubles[64];
+static float floats[64];
+static bool open_containers;
+
+static void *resize(void *buf, cbor_uint sz, void*)
+{
+  return std::realloc(buf, sz);
+}
+
+// random sequence of items, the same for the same seed
+static cbor_status encode(cbenc_ctx_t *ctx, uint32_t seed, int depth)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint mark, n, i;
+
+  test_seed = seed;
+
+  for(n = test_rand() % 24; n > 0 && cs == cbor_ok; n--) {
+    switch(test_rand() % ((depth > 2 || !open_containers)? 12 : 13)) {
+    case 0:  cs = cbenc_uint(ctx, static_cast<cbor_uint>(test_rand()) << test_rand() % 40); break;
+    case 1:  cs = cbenc_int(ctx, -static_cast<cbor_int>(test_rand())); break;
+    case 2:  cs = cbenc_bytestr(ctx, blob, test_rand() % (test_rand() % 8? 40 : 3000)); break;
+    case 3:  cs = cbenc_cstring(ctx, "text \xC3\xA9"); break;
+    case 4:  cs = cbenc_float(ctx, 1.0 / (test_rand() % 9 + 1)); break;
+    case 5:  cs = cbenc_float16(ctx, 1.5f); break;
+    case 6:  cs = cbenc_uint_array(ctx, uints, test_rand() % 64); break;
+    case 7:  cs = cbenc_float64_array(ctx, doubles, test_rand() % 64); break;
+    case 8:  cs = cbenc_float16_array(ctx, floats, test_rand() % 64); break;
+    case 9:  cs = cbenc_typed_array(ctx, cbor_tag_ta_u32be, uints, test_rand() % 64); break;
+
+    case 10:
+      // reserved space of any size, also more than an item header
+      cs = cbenc_reserve(ctx, 600);
+      if(cs != cbor_ok) { break; }
+
+      cbenc_put_array(ctx, 6);
+      cbenc_put_uint(ctx, test_rand());
+      cbenc_put_int(ctx, -static_cast<cbor_int>(test_rand()));
+      cbenc_put_bytestr(ctx, blob, 500);
+      cbenc_put_textstr(ctx, "key", 3);
+      cbenc_put_float64(ctx, 0.25);
+      cbenc_put_simple(ctx, cbor_true);
+      break;
+
+    case 11:
+      cs = cbenc_array_begin(ctx);
+      for(i = test_rand() % 5; i > 0 && cs == cbor_ok; i--) { cs = cbenc_float32(ctx, 2.5f); }
+      if(cs == cbor_ok) { cs = cbenc_break(ctx); }
+      break;
+
+    default:
+      i = test_rand();
+      cs = cbenc_array_open(ctx, &mark);
+      if(cs == cbor_ok) { cs = encode(ctx, i, depth + 1); }
+      if(cs == cbor_ok) { cs = cbenc_close(ctx, mark, 0); }
+      test_seed = i;
+      break;
+    }
+  }
+
+  return cs;
+}
+
+int main(int, char**)
+{
+  std::vector<uint8_t> buf;
+  cbor_uint i;
+  uint32_t it, held = 0;
+  cbor_status cs;
+
+  for(i = 0; i < 64; i++) {
+    uints[i] = i * i * i * 12345;
+    doubles[i] = i / 7.0;
+    floats[i] = i / 4.0f;
+  }
+
+  for(it = 0; it < 2000; it++) {
+    cbenc_ctx_t m = CBOR_ENCODER_MEASURE_CTX_INITIALIZER;
+    cbenc_ctx_t g = CBOR_ENCODER_MEM_CTX_INITIALIZER(resize, 0, nullptr);
+    void *data;
+    cbor_uint sz;
+
+    open_containers = it % 2;
+
+    cbenc_begin(&m);
+    TEST_CHECK(encode(&m, it, 0) == cbor_ok);
+    TEST_CHECK(cbenc_end(&m) == cbor_ok);
+
+    cbenc_begin(&g);
+    TEST_CHECK(encode(&g, it, 0) == cbor_ok);
+    TEST_CHECK(cbenc_end(&g) == cbor_ok);
+    cbenc_release(&g, &data, &sz);
+    TEST_CHECK(cbenc_size(&m) == sz);
+
+    // buffer of random size, but not less than the reserved space
+    buf.resize(640 + it * 37 % 4000);
+    test_out.clear();
+
+    cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+
+    cbenc_begin(&w);
+    cs = encode(&w, it, 0);
+    if(cs == cbor_ok) { cs = cbenc_end(&w); }
+
+    // write mode gives the same output, unless open containers do not fit the buffer
+    if(cs == cbor_ok) {
+      TEST_CHECK(test_out.size() == sz);
+      TEST_CHECK(sz == 0 || std::memcmp(test_out.data(), data, sz) == 0);
+      held += open_containers;
+    }
+    else {
+      TEST_CHECK(cs == cbor_enomem && open_containers);
+      TEST_CHECK(sz + 8 * CBOR_ENCODER_MAX_DEPTH > buf.size());
+    }
+
+    std::free(data);
+  }
+
+  TEST_CHECK(held > 0);
+
+  return test_result("measure");
+}
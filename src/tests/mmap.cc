@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "cbor-posix.h"
+#include "cbor-test.h"
+
+// temporary file with the data, removed when closed
+static int temp_file(const std::vector<uint8_t> &data)
+{
+  char name[] = "/tmp/cbor-test-XXXXXX";
+  int fd = mkstemp(name);
+
+  TEST_CHECK(fd >= 0);
+  unlink(name);
+  TEST_CHECK(write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+  return fd;
+}
+
+// top level items of about sz bytes in total and their offsets
+static std::vector<uint8_t> make_file(size_t sz, std::vector<cbor_uint> &items)
+{
+  std::vector<uint8_t> buf(4096);
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+
+  test_out.clear();
+  items.clear();
+  cbenc_begin(&w);
+  while(test_out.size() < sz) {
+    items.push_back(test_out.size());
+    test_doc(&w, (test_rand() % 8)? 40 : 20000, 0);
+    cbenc_end(&w);
+  }
+
+  return test_out;
+}
+
+// steps through the file next to a memory decoder over a copy, string views point into the map
+static void check_steps(cbor_mmap_t *map, cbdec_ctx_t *ctx, const std::vector<uint8_t> &data,
+                        cbor_uint off, const std::vector<cbor_uint> &items)
+{
+  cbdec_ctx_t m = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data() + off, data.size() - off);
+  size_t next = std::lower_bound(items.begin(), items.end(), off) - items.begin();
+  cbor_uint pos = off, tell;
+  cbor_status cs, mcs;
+  const void *p, *mp;
+  cbor_uint sz, msz;
+
+  TEST_CHECK(cbor_mmap_tell(map, ctx) == off);
+
+  for(;;) {
+    // every top level item starts at an offset the decoder is at
+    tell = cbor_mmap_tell(map, ctx);
+    while(next < items.size() && items[next] < tell) { TEST_CHECK(false); next++; }
+    if(next < items.size() && items[next] == tell) { next++; }
+
+    cs = cbdec_step(ctx);
+    mcs = cbdec_step(&m);
+    TEST_CHECK(cs == mcs && ctx->token == m.token && ctx->value.u == m.value.u);
+    if(cs != cbor_ok || mcs != cbor_ok) { break; }
+
+    // after the step the offset is the end of the item header
+    TEST_CHECK(cbor_mmap_tell(map, ctx) > pos);
+    pos = cbor_mmap_tell(map, ctx);
+
+    while((ctx->token == cbor_tbytestr || ctx->token == cbor_ttextstr) && ctx->value.u > 0) {
+      if(cbdec_sview(ctx, &p, &sz) != cbor_ok || cbdec_sview(&m, &mp, &msz) != cbor_ok) {
+        TEST_CHECK(false);
+        return;
+      }
+
+      TEST_CHECK(sz == msz && p == map->data + pos && std::memcmp(p, mp, sz) == 0);
+      pos = cbor_mmap_tell(map, ctx);
+    }
+  }
+
+  TEST_CHECK(cs == cbor_eos && next == items.size() && cbor_mmap_tell(map, ctx) == map->size);
+}
+
+int main(int, char**)
+{
+  static const size_t sizes[] = {1, 100, 4095, 4096, 4097, 70000, 3 << 20};
+  static const unsigned flags[] = {0, CBOR_MMAP_SEQUENTIAL, CBOR_MMAP_RANDOM, CBOR_MMAP_HUGEPAGE,
+                                   CBOR_MMAP_SEQUENTIAL | CBOR_MMAP_HUGEPAGE,
+                                   CBOR_MMAP_RANDOM | CBOR_MMAP_HUGEPAGE};
+  std::vector<cbor_uint> items;
+  std::vector<uint8_t> data;
+  cbor_mmap_t map;
+  cbdec_ctx_t ctx;
+  cbor_uint off;
+  uint32_t it;
+  int fd;
+
+  for(it = 0; it < 7 * 6 * 2; it++) {
+    test_seed = it;
+    data = make_file(sizes[it % 7], items);
+    fd = temp_file(data);
+
+    // the descriptor is not needed once mapped
+    TEST_CHECK(cbor_mmap_open(&map, &ctx, fd, flags[it / 7 % 6]) == cbor_ok);
+    close(fd);
+
+    TEST_CHECK(map.size == data.size() && std::vector<uint8_t>(map.data, map.data + map.size) ==
+               data);
+
+    check_steps(&map, &ctx, data, 0, items);
+
+    // jumps to items in any order, prefetching any size, validation is kept
+    for(int k = 0; k < 20 && !items.empty(); k++) {
+      off = items[test_rand() % items.size()];
+      ctx.utf8 = test_rand() % 2;
+      bool utf8 = ctx.utf8;
+
+      TEST_CHECK(cbor_mmap_seek(&map, &ctx, off, test_rand() % 100000) == cbor_ok);
+      TEST_CHECK(ctx.utf8 == utf8);
+      check_steps(&map, &ctx, data, off, items);
+    }
+
+    // the end of file is a valid offset, past it is not
+    TEST_CHECK(cbor_mmap_seek(&map, &ctx, map.size, 1) == cbor_ok);
+    TEST_CHECK(cbdec_step(&ctx) == cbor_eos);
+    TEST_CHECK(cbor_mmap_seek(&map, &ctx, map.size + 1, 0) == cbor_eos);
+
+    TEST_CHECK(cbor_mmap_close(&map) == cbor_ok && map.data == nullptr && map.size == 0);
+  }
+
+  // empty file has nothing to map
+  data.clear();
+  fd = temp_file(data);
+  TEST_CHECK(cbor_mmap_open(&map, &ctx, fd, CBOR_MMAP_HUGEPAGE) == cbor_ok && map.size == 0);
+  TEST_CHECK(cbdec_step(&ctx) == cbor_eos && cbor_mmap_tell(&map, &ctx) == 0);
+  TEST_CHECK(cbor_mmap_seek(&map, &ctx, 0, 10) == cbor_ok && cbdec_step(&ctx) == cbor_eos);
+  TEST_CHECK(cbor_mmap_close(&map) == cbor_ok);
+  close(fd);
+
+  TEST_CHECK(cbor_mmap_open(&map, &ctx, -1, 0) == cbor_eio);
+
+  return test_result("mmap");
+}
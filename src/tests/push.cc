@@ -0,0 +1,119 @@
+#include "cbor-test.h"
+
+// size of the next input fragment: empty, tiny, small or large
+static size_t fragment()
+{
+  switch(test_rand() % 6) {
+  case 0:  return 0;
+  case 1:  return 1;
+  case 2:  return 1 + test_rand() % 9;
+  case 3:  return 1 + test_rand() % 40;
+  default: return test_rand() % 2000;
+  }
+}
+
+// same text as test_trace for the memory decoder, input pushed in fragments
+static std::string push_trace(const std::vector<uint8_t> &data)
+{
+  cbpush_ctx_t ctx = CBOR_PUSH_CTX_INITIALIZER;
+  std::string out;
+  size_t pos = 0, len, off;
+  cbor_uint used, u, i;
+  cbor_status cs;
+  char line[64];
+  bool item = false;
+
+  while(pos < data.size()) {
+    len = fragment();
+    if(len > data.size() - pos) { len = data.size() - pos; }
+
+    // empty fragments have no data at all
+    const uint8_t *p = len? data.data() + pos : nullptr;
+
+    for(off = 0, cs = cbor_ok; cs == cbor_ok; off += used) {
+      if((ctx.token == cbor_tbytestr || ctx.token == cbor_ttextstr) && ctx.value.u > 0) {
+        cs = cbpush_sview(&ctx, len - off, &used);
+
+        for(i = 0; i < used; i++) {
+          std::snprintf(line, sizeof(line), " %02x", p[off + i]);
+          out += line;
+        }
+        continue;
+      }
+
+      cs = cbpush_step(&ctx, p? p + off : nullptr, len - off, &used);
+
+      if(cs == cbor_ok) {
+        u = (ctx.token == cbor_tsimple)? static_cast<cbor_uint>(ctx.value.st) : ctx.value.u;
+        std::snprintf(line, sizeof(line), "%s%d %llx", item? "\n" : "",
+                      static_cast<int>(ctx.token), static_cast<unsigned long long>(u));
+        out += line;
+        item = true;
+      }
+    }
+
+    if(cs != cbor_eagain) {
+      std::snprintf(line, sizeof(line), "%sstatus %d\n", item? "\n" : "", static_cast<int>(cs));
+      return out + line;
+    }
+
+    // the whole fragment is consumed before asking for more
+    TEST_CHECK(off == len);
+    pos += len;
+  }
+
+  std::snprintf(line, sizeof(line), "%sstatus %d\n", item? "\n" : "",
+                static_cast<int>(cbor_eos));
+  return out + line;
+}
+
+static void check_split()
+{
+  static const uint8_t data[] = {0x9B, 1, 2, 3, 4, 5, 6, 7, 8, 0x1B, 0, 0, 0, 1, 0, 0, 0, 0,
+                                 0x81, 0x1C};
+  cbpush_ctx_t ctx = CBOR_PUSH_CTX_INITIALIZER;
+  cbor_uint used;
+  size_t i;
+
+  // headers arrive byte by byte
+  for(i = 0; i < 8; i++) {
+    TEST_CHECK(cbpush_step(&ctx, data + i, 1, &used) == cbor_eagain && used == 1);
+  }
+  TEST_CHECK(cbpush_step(&ctx, nullptr, 0, &used) == cbor_eagain && used == 0);
+  TEST_CHECK(cbpush_step(&ctx, data + 8, 3, &used) == cbor_ok && used == 1);
+  TEST_CHECK(ctx.token == cbor_tarray && ctx.value.u == 0x0102030405060708ull);
+
+  TEST_CHECK(cbpush_step(&ctx, data + 9, 4, &used) == cbor_eagain && used == 4);
+  TEST_CHECK(cbpush_step(&ctx, data + 13, 7, &used) == cbor_ok && used == 5);
+  TEST_CHECK(ctx.token == cbor_tuint && ctx.value.u == 0x100000000ull);
+
+  // malformed header after a split one
+  TEST_CHECK(cbpush_step(&ctx, data + 18, 1, &used) == cbor_ok && ctx.token == cbor_tarray);
+  TEST_CHECK(cbpush_step(&ctx, data + 19, 1, &used) == cbor_efmt);
+}
+
+int main(int, char**)
+{
+  std::vector<uint8_t> buf(4096);
+  std::string ref;
+  uint32_t it;
+
+  for(it = 0; it < 3000; it++) {
+    cbenc_ctx_t enc = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+
+    test_seed = it;
+    test_out.clear();
+    cbenc_begin(&enc);
+    for(int n = test_rand() % 8; n >= 0; n--) { test_doc(&enc, (it % 4)? 40 : 3000, 0); }
+    cbenc_end(&enc);
+
+    cbdec_ctx_t mem = CBOR_DECODER_MEM_CTX_INITIALIZER(test_out.data(), test_out.size());
+    ref = test_trace(&mem, true, 0);
+
+    TEST_CHECK(push_trace(test_out) == ref);
+  }
+
+  check_split();
+
+  return test_result("push");
+}
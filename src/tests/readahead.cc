@@ -0,0 +1,82 @@
+#include <algorithm>
+#include "cbor-test.h"
+
+// input stream over the encoded data, fill returns short reads of random size
+struct source
+{
+  const std::vector<uint8_t> *data;
+  size_t pos;
+  bool partial;
+};
+
+static cbor_status fill(void *data, cbor_uint *sz, void *usrdata)
+{
+  source *src = static_cast<source*>(usrdata);
+  cbor_uint n = src->data->size() - src->pos;
+
+  if(n > *sz) { n = *sz; }
+  if(src->partial && n > 1) { n = 1 + test_rand() % n; }
+
+  std::copy(src->data->begin() + src->pos, src->data->begin() + src->pos + n,
+            static_cast<uint8_t*>(data));
+  src->pos += n;
+  *sz = n;
+
+  return cbor_ok;
+}
+
+static cbor_status read(void *data, cbor_uint sz, void *usrdata)
+{
+  source *src = static_cast<source*>(usrdata);
+
+  if(src->data->size() - src->pos < sz) { return cbor_eos; }
+
+  std::copy(src->data->begin() + src->pos, src->data->begin() + src->pos + sz,
+            static_cast<uint8_t*>(data));
+  src->pos += sz;
+
+  return cbor_ok;
+}
+
+int main(int, char**)
+{
+  static const cbor_uint sizes[] = {8, 9, 16, 61, 512, 4096};
+  std::vector<uint8_t> buf(4096), rabuf(4096), data;
+  std::string ref;
+  uint32_t it, seed;
+
+  for(it = 0; it < 1500; it++) {
+    cbenc_ctx_t enc = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+
+    test_seed = it;
+    test_out.clear();
+    cbenc_begin(&enc);
+    for(int n = test_rand() % 8; n >= 0; n--) { test_doc(&enc, (it % 4)? 40 : 3000, 0); }
+    cbenc_end(&enc);
+    data = test_out;
+
+    // string pieces depend on the data source, the decoded items must not
+    cbdec_ctx_t mem = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size());
+    ref = test_trace(&mem, true, 0);
+    TEST_CHECK(ref.compare(ref.size() - 9, 9, "status 1\n") == 0);
+
+    source src = {&data, 0, false};
+    cbdec_ctx_t rd = CBOR_DECODER_CTX_INITIALIZER(read, &src);
+    TEST_CHECK(test_trace(&rd, it % 2, 1 + it % 100) == ref);
+
+    for(cbor_uint sz : sizes) {
+      seed = test_seed;
+
+      src = {&data, 0, (it % 3) == 0};
+      cbdec_ctx_t ra = CBOR_DECODER_BUF_CTX_INITIALIZER(fill, rabuf.data(), sz, &src);
+      TEST_CHECK(test_trace(&ra, true, 0) == ref);
+
+      // reads smaller and larger than the buffer
+      src = {&data, 0, (it % 3) == 1};
+      cbdec_ctx_t rs = CBOR_DECODER_BUF_CTX_INITIALIZER(fill, rabuf.data(), sz, &src);
+      TEST_CHECK(test_trace(&rs, false, 1 + (seed % 2) * sz + seed % 700) == ref);
+    }
+  }
+
+  return test_result("readahead");
+}
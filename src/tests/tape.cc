@@ -0,0 +1,214 @@
+#include <cstring>
+#include "cbor-test.h"
+
+// item found by sequential decoding
+struct node
+{
+  size_t offset;
+  cbor_token token;
+  cbor_uint value;
+  size_t next;
+  std::vector<size_t> elems;
+  std::vector<uint8_t> str;
+};
+
+static const uint8_t *base;
+
+// decodes the next item with its subtree, returns false on break
+static bool decode(cbdec_ctx_t *ctx, std::vector<node> &nodes)
+{
+  size_t idx = nodes.size(), offset = ctx->pos - base;
+  const void *data;
+  cbor_uint i, n = 0, sz;
+
+  TEST_CHECK(cbdec_step(ctx) == cbor_ok);
+  if(ctx->token == cbor_tbreak) { return false; }
+
+  nodes.push_back(node());
+  nodes[idx].offset = offset;
+  nodes[idx].token  = ctx->token;
+  nodes[idx].value  = (ctx->token == cbor_tsimple)? static_cast<cbor_uint>(ctx->value.st) :
+                                                    ctx->value.u;
+
+  switch(ctx->token) {
+  case cbor_tbytestr:
+  case cbor_ttextstr:
+    while(ctx->value.u > 0 && cbdec_sview(ctx, &data, &sz) == cbor_ok) {
+      const uint8_t *p = static_cast<const uint8_t*>(data);
+      nodes[idx].str.insert(nodes[idx].str.end(), p, p + sz);
+    }
+    break;
+
+  case cbor_tarray: n = ctx->value.u;     break;
+  case cbor_tmap:   n = ctx->value.u * 2; break;
+  case cbor_ttag:   n = 1;                break;
+
+  case cbor_tvbytestr:
+  case cbor_tvtextstr:
+  case cbor_tvarray:
+  case cbor_tvmap:
+    for(;;) {
+      size_t elem = nodes.size();
+      if(!decode(ctx, nodes)) { break; }
+      nodes[idx].elems.push_back(elem);
+    }
+
+    nodes[idx].value = nodes[idx].elems.size() / ((nodes[idx].token == cbor_tvmap)? 2 : 1);
+    break;
+
+  default: break;
+  }
+
+  for(i = 0; i < n; i++) {
+    nodes[idx].elems.push_back(nodes.size());
+    decode(ctx, nodes);
+  }
+
+  nodes[idx].next = nodes.size();
+  return true;
+}
+
+// random document with maps keyed by text strings, keys may repeat
+static void make_doc(cbenc_ctx_t *ctx, int depth)
+{
+  static const char *keys[] = {"id", "name", "x", "values", "key \xC3\xA9", ""};
+  uint32_t i, n;
+
+  if(depth > 3 || test_rand() % 3 == 0) {
+    test_doc(ctx, 300, 3);
+    return;
+  }
+
+  n = test_rand() % 7;
+
+  switch(test_rand() % 3) {
+  case 0:
+    cbenc_array(ctx, n);
+    for(i = 0; i < n; i++) { make_doc(ctx, depth + 1); }
+    break;
+
+  case 1:
+    cbenc_map(ctx, n);
+    for(i = 0; i < n; i++) {
+      cbenc_cstring(ctx, keys[test_rand() % 6]);
+      make_doc(ctx, depth + 1);
+    }
+    break;
+
+  default:
+    cbenc_map_begin(ctx);
+    for(i = 0; i < n; i++) {
+      cbenc_cstring(ctx, keys[test_rand() % 6]);
+      make_doc(ctx, depth + 1);
+    }
+    cbenc_break(ctx);
+    break;
+  }
+}
+
+static void check(const std::vector<uint8_t> &data)
+{
+  static cbtape_item_t items[8192];
+  cbtape_t tape = CBOR_TAPE_INITIALIZER(items, sizeof(items) / sizeof(items[0]));
+  cbdec_ctx_t ctx = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size());
+  std::vector<node> nodes;
+  const void *p;
+  cbor_uint sz, n;
+  size_t i, j, res;
+
+  base = data.data();
+  while(ctx.pos < ctx.end) { decode(&ctx, nodes); }
+
+  TEST_CHECK(cbtape_parse(&tape, data.data(), data.size()) == cbor_ok);
+  TEST_CHECK(tape.count == nodes.size());
+  if(tape.count != nodes.size()) { return; }
+
+  for(i = 0; i < nodes.size(); i++) {
+    const cbtape_item_t &item = items[i];
+    const node &nd = nodes[i];
+
+    TEST_CHECK(item.offset == nd.offset && item.token == nd.token && item.next == nd.next);
+    TEST_CHECK(((item.token == cbor_tsimple)? static_cast<cbor_uint>(item.value.st) :
+                                              item.value.u) == nd.value);
+
+    // random access to every element and one past the last
+    for(j = 0; j < nd.elems.size(); j++) {
+      TEST_CHECK(cbtape_at(&tape, i, j, &res) == cbor_ok && res == nd.elems[j]);
+    }
+
+    n = nd.elems.size();
+    if(nd.token == cbor_tarray || nd.token == cbor_tmap || nd.token == cbor_ttag ||
+       nd.token == cbor_tvarray || nd.token == cbor_tvmap || nd.token == cbor_tvbytestr ||
+       nd.token == cbor_tvtextstr) {
+      TEST_CHECK(cbtape_at(&tape, i, n, &res) == cbor_eos);
+    }
+    else {
+      TEST_CHECK(cbtape_at(&tape, i, 0, &res) == cbor_efmt);
+    }
+
+    if(nd.token == cbor_tbytestr || nd.token == cbor_ttextstr) {
+      TEST_CHECK(cbtape_sview(&tape, i, &p, &sz) == cbor_ok && sz == nd.str.size());
+      TEST_CHECK(sz == 0 || std::memcmp(p, nd.str.data(), sz) == 0);
+    }
+    else {
+      TEST_CHECK(cbtape_sview(&tape, i, &p, &sz) == cbor_efmt);
+    }
+
+    if(nd.token != cbor_tmap && nd.token != cbor_tvmap) {
+      TEST_CHECK(cbtape_find(&tape, i, "id", 2, &res) == cbor_efmt);
+      continue;
+    }
+
+    // every text key finds the value of its first occurrence
+    for(j = 0; j < nd.elems.size(); j += 2) {
+      const node &key = nodes[nd.elems[j]];
+      size_t k = j;
+
+      if(key.token != cbor_ttextstr) { continue; }
+
+      while(k > 0) {
+        const node &prev = nodes[nd.elems[k - 2]];
+        if(prev.token == cbor_ttextstr && prev.str == key.str) { break; }
+        k -= 2;
+      }
+      if(k > 0) { continue; }
+
+      const char *s = key.str.empty()? "" : reinterpret_cast<const char*>(key.str.data());
+      TEST_CHECK(cbtape_find(&tape, i, s, key.str.size(), &res) == cbor_ok);
+      TEST_CHECK(res == nd.elems[j + 1]);
+    }
+
+    TEST_CHECK(cbtape_find(&tape, i, "missing", 7, &res) == cbor_eos);
+  }
+
+  // out of range indexes
+  TEST_CHECK(cbtape_at(&tape, tape.count, 0, &res) == cbor_efmt);
+  TEST_CHECK(cbtape_sview(&tape, tape.count, &p, &sz) == cbor_efmt);
+
+  // a tape one item too short
+  if(tape.count > 0) {
+    cbtape_t small = CBOR_TAPE_INITIALIZER(items, tape.count - 1);
+    TEST_CHECK(cbtape_parse(&small, data.data(), data.size()) == cbor_enomem);
+  }
+}
+
+int main(int, char**)
+{
+  uint8_t buf[256];
+  uint32_t it;
+
+  for(it = 0; it < 5000; it++) {
+    cbenc_ctx_t enc = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf, sizeof(buf), nullptr);
+
+    test_seed = it;
+    test_out.clear();
+    cbenc_begin(&enc);
+    // a single item or a sequence
+    for(int n = (it % 2)? 0 : test_rand() % 4; n >= 0; n--) { make_doc(&enc, 0); }
+    cbenc_end(&enc);
+
+    check(test_out);
+  }
+
+  return test_result("tape");
+}
@@ -0,0 +1,167 @@
+#include <cstdlib>
+#include <cstring>
+#include "cbor-test.h"
+
+static void *resize(void *buf, cbor_uint sz, void*)
+{
+  return std::realloc(buf, sz);
+}
+
+static cbor_status read(void *data, cbor_uint sz, void *usrdata)
+{
+  std::vector<uint8_t> *src = static_cast<std::vector<uint8_t>*>(usrdata);
+
+  if(src->size() < sz) { return cbor_eos; }
+
+  std::memcpy(data, src->data(), sz);
+  src->erase(src->begin(), src->begin() + sz);
+  return cbor_ok;
+}
+
+static size_t elem_size(unsigned tag)
+{
+  return (tag & 0x10)? 2u << (tag & 3) : 1u << (tag & 3);
+}
+
+static void put_head(std::vector<uint8_t> &out, uint8_t major, uint64_t val)
+{
+  int size;
+
+  if(val < 24) { out.push_back(static_cast<uint8_t>(major | val)); return; }
+
+  if(val <= 0xFF) { out.push_back(major | 24); size = 1; }
+  else if(val <= 0xFFFF) { out.push_back(major | 25); size = 2; }
+  else { out.push_back(major | 26); size = 4; }
+
+  while(size--) { out.push_back(static_cast<uint8_t>(val >> size * 8)); }
+}
+
+// encoding of the tag and the elements, byte by byte on the host side
+static std::vector<uint8_t> reference(unsigned tag, const uint8_t *data, size_t count)
+{
+  const uint16_t one = 1;
+  bool little = *reinterpret_cast<const uint8_t*>(&one) == 1;
+  size_t size = elem_size(tag), i, k;
+  bool swap = size > 1 && little != ((tag & 4) != 0);
+  std::vector<uint8_t> out;
+
+  put_head(out, 0xC0, tag);
+  put_head(out, 0x40, count * size);
+
+  for(i = 0; i < count; i++) {
+    for(k = 0; k < size; k++) { out.push_back(data[i * size + (swap? size - 1 - k : k)]); }
+  }
+
+  return out;
+}
+
+static void check(unsigned tag, size_t count, size_t bufsz)
+{
+  size_t size = elem_size(tag), i, n, off = test_rand() % 16;
+  std::vector<uint8_t> src(off + count * size), buf(bufsz), out, rd;
+  const uint8_t *data;
+  cbor_uint sz, step;
+  void *mem;
+
+  for(i = off; i < src.size(); i++) { src[i] = static_cast<uint8_t>(test_rand()); }
+
+  // elements at any alignment
+  data = src.data() + off;
+  std::vector<uint8_t> ref = reference(tag, data, count);
+
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+  test_out.clear();
+  cbenc_begin(&w);
+  TEST_CHECK(cbenc_typed_array(&w, static_cast<cbor_tag>(tag), data, count) == cbor_ok);
+  TEST_CHECK(cbenc_end(&w) == cbor_ok);
+  TEST_CHECK(test_out == ref);
+
+  cbenc_ctx_t g = CBOR_ENCODER_MEM_CTX_INITIALIZER(resize, test_rand() % 40, nullptr);
+  cbenc_begin(&g);
+  TEST_CHECK(cbenc_typed_array(&g, static_cast<cbor_tag>(tag), data, count) == cbor_ok);
+  TEST_CHECK(cbenc_end(&g) == cbor_ok);
+  cbenc_release(&g, &mem, &sz);
+  TEST_CHECK(sz == ref.size() && std::memcmp(mem, ref.data(), sz) == 0);
+  std::free(mem);
+
+  cbenc_ctx_t m = CBOR_ENCODER_MEASURE_CTX_INITIALIZER;
+  cbenc_begin(&m);
+  TEST_CHECK(cbenc_typed_array(&m, static_cast<cbor_tag>(tag), data, count) == cbor_ok);
+  TEST_CHECK(cbenc_end(&m) == cbor_ok && cbenc_size(&m) == ref.size());
+
+  // decoded in parts of random size, from memory and with the read callback
+  for(int mode = 0; mode < 2; mode++) {
+    cbdec_ctx_t mdec = CBOR_DECODER_MEM_CTX_INITIALIZER(ref.data(), ref.size());
+    cbdec_ctx_t rdec = CBOR_DECODER_CTX_INITIALIZER(read, &rd);
+    cbdec_ctx_t *dec = mode? &rdec : &mdec;
+
+    rd = ref;
+    out.assign(off + count * size, 0);
+
+    TEST_CHECK(cbdec_step(dec) == cbor_ok && dec->token == cbor_ttag && dec->value.u == tag);
+    TEST_CHECK(cbdec_step(dec) == cbor_ok && dec->token == cbor_tbytestr);
+
+    for(n = 0; n < count; n += step) {
+      step = 1 + test_rand() % (test_rand() % 2? 4 : count);
+      TEST_CHECK(cbdec_typed_array(dec, tag, out.data() + off + n * size, step) == cbor_ok);
+      if(step > count - n) { step = count - n; }
+    }
+
+    TEST_CHECK(dec->value.u == 0 && cbdec_typed_array(dec, tag, out.data(), 1) == cbor_ok);
+    TEST_CHECK(count == 0 || std::memcmp(out.data() + off, data, count * size) == 0);
+  }
+}
+
+static void check_malformed()
+{
+  static const uint8_t odd[] = {0xD8, cbor_tag_ta_u32be, 0x46, 1, 2, 3, 4, 5, 6};
+  static const uint8_t empty_array[] = {0x80};
+  static const unsigned tags[] = {63, 76, 88, 0, 1000};
+  uint8_t buf[64], data[8] = {0};
+
+  // not typed array tags
+  for(unsigned tag : tags) {
+    cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf, sizeof(buf), nullptr);
+    cbenc_begin(&w);
+    TEST_CHECK(cbenc_typed_array(&w, static_cast<cbor_tag>(tag), data, 1) == cbor_efmt);
+
+    cbdec_ctx_t dec = CBOR_DECODER_MEM_CTX_INITIALIZER(odd + 2, 5);
+    TEST_CHECK(cbdec_step(&dec) == cbor_ok);
+    TEST_CHECK(cbdec_typed_array(&dec, tag, data, 1) == cbor_efmt);
+  }
+
+  // size that is not a multiple of the element size
+  cbdec_ctx_t dec = CBOR_DECODER_MEM_CTX_INITIALIZER(odd, sizeof(odd));
+  TEST_CHECK(cbdec_step(&dec) == cbor_ok && cbdec_step(&dec) == cbor_ok);
+  TEST_CHECK(cbdec_typed_array(&dec, cbor_tag_ta_u32be, data, 2) == cbor_efmt);
+
+  // not a byte string
+  cbdec_ctx_t arr = CBOR_DECODER_MEM_CTX_INITIALIZER(empty_array, 1);
+  TEST_CHECK(cbdec_step(&arr) == cbor_ok);
+  TEST_CHECK(cbdec_typed_array(&arr, cbor_tag_ta_u8, data, 1) == cbor_efmt);
+}
+
+int main(int, char**)
+{
+  // byte sizes around the 16 and 32 byte blocks of the vector byte swap
+  static const size_t counts[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+                                  100, 1000};
+  static const size_t bufs[] = {CBOR_ENCODER_MIN_BUFFER_SIZE, 10, 16, 17, 33, 100, 4096};
+  uint32_t it = 0;
+  unsigned tag;
+
+  for(tag = cbor_tag_ta_u8; tag <= cbor_tag_ta_f128le; tag++) {
+    if(tag == 76) { continue; }
+
+    for(size_t count : counts) {
+      for(size_t bufsz : bufs) {
+        test_seed = it++;
+        check(tag, count, bufsz);
+      }
+    }
+  }
+
+  check_malformed();
+
+  return test_result("typed");
+}
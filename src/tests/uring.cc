@@ -0,0 +1,182 @@
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "cbor-posix.h"
+#include "cbor-test.h"
+
+// temporary file, removed when closed
+static int temp_file(int flags)
+{
+  char name[] = "/tmp/cbor-test-XXXXXX";
+  int fd = mkostemp(name, flags);
+
+  TEST_CHECK(fd >= 0);
+  unlink(name);
+  return fd;
+}
+
+static std::vector<uint8_t> file_data(int fd)
+{
+  std::vector<uint8_t> data(lseek(fd, 0, SEEK_END));
+
+  TEST_CHECK(pread(fd, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+  return data;
+}
+
+static void put(int fd, const std::vector<uint8_t> &data)
+{
+  TEST_CHECK(write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+}
+
+// random items, the same for the same seed, strings longer than the buffers included
+static void encode(cbenc_ctx_t *ctx, uint32_t seed, int depth = 0)
+{
+  static uint8_t blob[20000];
+  uint32_t i, n;
+
+  if(depth == 0) {
+    for(i = 0; i < sizeof(blob); i++) { blob[i] = static_cast<uint8_t>(i * 7 + i / 251); }
+    test_seed = seed;
+  }
+
+  for(n = test_rand() % (depth? 6 : 40); n > 0; n--) {
+    switch(test_rand() % ((depth > 2)? 5 : 7)) {
+    case 0: cbenc_uint(ctx, static_cast<cbor_uint>(test_rand()) << test_rand() % 40); break;
+    case 1: cbenc_int(ctx, -static_cast<cbor_int>(test_rand())); break;
+    case 2: cbenc_float64(ctx, test_rand() / 3.0); break;
+    case 3: cbenc_cstring(ctx, "text \xC3\xA9"); break;
+    case 4: cbenc_bytestr(ctx, blob, test_rand() % ((test_rand() % 8)? 50 : sizeof(blob))); break;
+
+    case 5:
+      cbenc_array(ctx, 3);
+      for(i = 0; i < 3; i++) { encode(ctx, seed, depth + 3); }
+      break;
+
+    default:
+      cbenc_array_begin(ctx);
+      encode(ctx, seed, depth + 1);
+      cbenc_break(ctx);
+      break;
+    }
+  }
+}
+
+static std::vector<uint8_t> reference(uint32_t seed)
+{
+  static std::vector<uint8_t> big(1 << 22);
+  cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, big.data(), big.size(), nullptr);
+
+  test_out.clear();
+  cbenc_begin(&w);
+  encode(&w, seed);
+  cbenc_end(&w);
+
+  return test_out;
+}
+
+// two messages written from the file position, the file is also written by others around them
+static void check_write(uint32_t it, int flags)
+{
+  static const cbor_uint bufs[] = {CBOR_ENCODER_MIN_BUFFER_SIZE, 16, 100, 4096, 65536};
+  static const cbor_uint syncs[] = {0, 1, 1000};
+  std::vector<uint8_t> ref = reference(it), ref2 = reference(it + 1000), stale(64), mem;
+  std::vector<uint8_t> before(it % 7, 0xF6), between(it % 3, 0xF7), after(1, 0xF5), expect;
+  cbor_uint bufsz = bufs[it % 5];
+  unsigned depth = 2 + it / 5 % 4 * 4;
+  cbor_uring_t uring;
+  int fd = temp_file(flags);
+
+  mem.assign(bufsz * depth, 0);
+  put(fd, before);
+
+  // the context was used before: the item left in its buffer is not written
+  cbenc_ctx_t c = CBOR_ENCODER_CTX_INITIALIZER(test_write, stale.data(), stale.size(), nullptr);
+  cbenc_begin(&c);
+  cbenc_uint(&c, 12345);
+
+  TEST_CHECK(cbor_uring_write_start(&uring, &c, fd, mem.data(), bufsz, depth,
+                                    syncs[it % 3]) == cbor_ok);
+  encode(&c, it);
+  TEST_CHECK(cbenc_end(&c) == cbor_ok);
+  TEST_CHECK(lseek(fd, 0, SEEK_CUR) == static_cast<off_t>(before.size() + ref.size()));
+
+  put(fd, between);
+  cbenc_begin(&c);
+  encode(&c, it + 1000);
+  TEST_CHECK(cbenc_end(&c) == cbor_ok);
+
+  TEST_CHECK(cbor_uring_stop(&uring) == cbor_ok);
+  put(fd, after);
+
+  expect = before;
+  expect.insert(expect.end(), ref.begin(), ref.end());
+  expect.insert(expect.end(), between.begin(), between.end());
+  expect.insert(expect.end(), ref2.begin(), ref2.end());
+  expect.insert(expect.end(), after.begin(), after.end());
+  TEST_CHECK(file_data(fd) == expect);
+
+  close(fd);
+}
+
+// message read from the file position with the read-ahead and the read callback
+static void check_read(uint32_t it)
+{
+  static const cbor_uint bufs[] = {1, 9, 100, 4096, 65536};
+  std::vector<uint8_t> ref = reference(it), before(it % 5, 0xF6), mem, rabuf(8 + it % 50);
+  cbor_uint bufsz = bufs[it % 5];
+  unsigned depth = 1 + it / 5 % CBOR_URING_MAX_DEPTH;
+  cbor_uring_t uring;
+  int fd = temp_file(0);
+
+  mem.assign(bufsz * depth, 0);
+  put(fd, before);
+  put(fd, ref);
+
+  cbdec_ctx_t m = CBOR_DECODER_MEM_CTX_INITIALIZER(ref.data(), ref.size());
+  std::string trace = test_trace(&m, false, 1 + it % 700);
+
+  for(int mode = 0; mode < 2; mode++) {
+    TEST_CHECK(lseek(fd, before.size(), SEEK_SET) == static_cast<off_t>(before.size()));
+    TEST_CHECK(cbor_uring_read_start(&uring, fd, mem.data(), bufsz, depth) == cbor_ok);
+
+    cbdec_ctx_t b = CBOR_DECODER_BUF_CTX_INITIALIZER(cbor_uring_fill, rabuf.data(), rabuf.size(),
+                                                     &uring);
+    cbdec_ctx_t r = CBOR_DECODER_CTX_INITIALIZER(cbor_uring_read, &uring);
+    TEST_CHECK(test_trace(mode? &r : &b, false, 1 + it % 700) == trace);
+
+    // the whole file is consumed
+    TEST_CHECK(cbor_uring_stop(&uring) == cbor_ok);
+    TEST_CHECK(lseek(fd, 0, SEEK_CUR) == static_cast<off_t>(before.size() + ref.size()));
+  }
+
+  close(fd);
+}
+
+int main(int, char**)
+{
+  std::vector<uint8_t> mem(4096);
+  cbor_uring_t uring;
+  uint32_t it;
+
+  for(it = 0; it < 300; it++) {
+    check_write(it, 0);
+
+    // writes at explicit offsets are not possible with O_APPEND, the encoder writes directly
+    check_write(it, O_APPEND);
+
+    check_read(it);
+  }
+
+  // buffer count and size out of range
+  cbenc_ctx_t c = CBOR_ENCODER_CTX_INITIALIZER(0, 0, 0, 0);
+  TEST_CHECK(cbor_uring_write_start(&uring, &c, 0, mem.data(), 16, 1, 0) == cbor_enomem);
+  TEST_CHECK(cbor_uring_write_start(&uring, &c, 0, mem.data(), 16, CBOR_URING_MAX_DEPTH + 1,
+                                    0) == cbor_enomem);
+  TEST_CHECK(cbor_uring_write_start(&uring, &c, 0, mem.data(), CBOR_ENCODER_MIN_BUFFER_SIZE - 1,
+                                    2, 0) == cbor_enomem);
+  TEST_CHECK(cbor_uring_read_start(&uring, 0, mem.data(), 16, 0) == cbor_enomem);
+  TEST_CHECK(cbor_uring_read_start(&uring, 0, mem.data(), 0, 1) == cbor_enomem);
+
+  return test_result("uring");
+}
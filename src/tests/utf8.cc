@@ -0,0 +1,294 @@
+#include <cstring>
+#include "cbor-test.h"
+
+// reference UTF-8 check by decoding code points (RFC 3629)
+static bool ref_valid(const uint8_t *p, size_t n)
+{
+  static const uint32_t min[] = {0, 0, 0x80, 0x800, 0x10000};
+  size_t i = 0, len, k;
+  uint32_t cp;
+
+  while(i < n) {
+    if(p[i] < 0x80) { i++; continue; }
+
+    if((p[i] & 0xE0) == 0xC0) { len = 2; cp = p[i] & 0x1F; }
+    else if((p[i] & 0xF0) == 0xE0) { len = 3; cp = p[i] & 0x0F; }
+    else if((p[i] & 0xF8) == 0xF0) { len = 4; cp = p[i] & 0x07; }
+    else { return false; }
+
+    if(n - i < len) { return false; }
+
+    for(k = 1; k < len; k++) {
+      if((p[i + k] & 0xC0) != 0x80) { return false; }
+      cp = cp << 6 | (p[i + k] & 0x3F);
+    }
+
+    if(cp < min[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) { return false; }
+    i += len;
+  }
+
+  return true;
+}
+
+static void put_char(std::vector<uint8_t> &s, uint32_t cp)
+{
+  if(cp < 0x80) { s.push_back(static_cast<uint8_t>(cp)); }
+  else if(cp < 0x800) {
+    s.push_back(static_cast<uint8_t>(0xC0 | cp >> 6));
+    s.push_back(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+  }
+  else if(cp < 0x10000) {
+    s.push_back(static_cast<uint8_t>(0xE0 | cp >> 12));
+    s.push_back(static_cast<uint8_t>(0x80 | (cp >> 6 & 0x3F)));
+    s.push_back(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+  }
+  else {
+    s.push_back(static_cast<uint8_t>(0xF0 | cp >> 18));
+    s.push_back(static_cast<uint8_t>(0x80 | (cp >> 12 & 0x3F)));
+    s.push_back(static_cast<uint8_t>(0x80 | (cp >> 6 & 0x3F)));
+    s.push_back(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+  }
+}
+
+// valid string of about sz bytes, mostly ASCII or mostly multibyte, edge code points included
+static std::vector<uint8_t> make_text(size_t sz)
+{
+  static const uint32_t edges[] = {0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFF, 0x10000,
+                                   0x10FFFF};
+  std::vector<uint8_t> s;
+  uint32_t ascii = test_rand() % 4;
+
+  while(s.size() < sz) {
+    switch(test_rand() % 8) {
+    case 0:  put_char(s, 0x80 + test_rand() % 0x780); break;
+    case 1:  put_char(s, 0x800 + test_rand() % 0xD000); break;
+    case 2:  put_char(s, 0x10000 + test_rand() % 0x100000); break;
+    case 3:  put_char(s, edges[test_rand() % 9]); break;
+    default: put_char(s, (test_rand() % 4 < ascii)? test_rand() % 0x80 : 0x3B1); break;
+    }
+  }
+
+  // exact size, the last character may become incomplete
+  if(test_rand() % 2) { s.resize(sz); }
+  return s;
+}
+
+// damages the string at a random position, the result is usually but not always malformed
+static void damage(std::vector<uint8_t> &s)
+{
+  static const char *bad[] = {
+    "\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xED\xA0\x80",
+    "\xED\xBF\xBF", "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80",
+    "\xF8\x88\x80\x80\x80", "\xFC\x84\x80\x80\x80\x80", "\xFE", "\xFF", "\xC3", "\xE2\x82",
+    "\xF0\x9F\x98"
+  };
+  size_t pos = s.empty()? 0 : test_rand() % (s.size() + 1);
+  const char *b;
+
+  switch(test_rand() % 3) {
+  case 0:
+    if(!s.empty()) { s[pos % s.size()] = static_cast<uint8_t>(test_rand()); }
+    break;
+
+  case 1:
+    // near the end, where the vector code handles incomplete sequences
+    if(s.size() > 4 && test_rand() % 2) { pos = s.size() - test_rand() % 4; }
+    b = bad[test_rand() % (sizeof(bad) / sizeof(bad[0]))];
+    s.insert(s.begin() + pos, b, b + std::strlen(b));
+    break;
+
+  default:
+    s.insert(s.begin() + pos, static_cast<uint8_t>(0x80 | test_rand() % 0x40));
+    break;
+  }
+}
+
+static void put_head(std::vector<uint8_t> &out, uint8_t major, uint64_t val)
+{
+  int size;
+
+  if(val < 24) { out.push_back(static_cast<uint8_t>(major | val)); return; }
+
+  if(val <= 0xFF) { out.push_back(major | 24); size = 1; }
+  else if(val <= 0xFFFF) { out.push_back(major | 25); size = 2; }
+  else { out.push_back(major | 26); size = 4; }
+
+  while(size--) { out.push_back(static_cast<uint8_t>(val >> size * 8)); }
+}
+
+struct source
+{
+  const std::vector<uint8_t> *data;
+  size_t pos;
+};
+
+static cbor_status fill(void *data, cbor_uint *sz, void *usrdata)
+{
+  source *src = static_cast<source*>(usrdata);
+  cbor_uint n = src->data->size() - src->pos;
+
+  if(n > *sz) { n = *sz; }
+  if(n > 1) { n = 1 + test_rand() % n; }
+
+  std::memcpy(data, src->data->data() + src->pos, n);
+  src->pos += n;
+  *sz = n;
+  return cbor_ok;
+}
+
+// decodes one text string with validation, reading it in pieces
+static cbor_status decode(cbdec_ctx_t *ctx)
+{
+  cbor_status cs;
+  const void *p;
+  cbor_uint sz;
+
+  ctx->utf8 = 1;
+  if((cs = cbdec_step(ctx)) != cbor_ok) { return cs; }
+
+  if(ctx->token == cbor_ttextstr) {
+    while(ctx->value.u > 0 && (cs = cbdec_sview(ctx, &p, &sz)) == cbor_ok) {}
+    return cs;
+  }
+
+  while((cs = cbdec_schunk(ctx, &p, &sz)) == cbor_ok && ctx->token != cbor_tbreak) {}
+  return cs;
+}
+
+static void check(const std::vector<uint8_t> &s)
+{
+  std::vector<uint8_t> data, chunks, rabuf(8 + test_rand() % 40);
+  std::vector<cbor_iovec_t> iov;
+  bool valid = ref_valid(s.data(), s.size()), cvalid = true;
+  cbor_status expect = valid? cbor_ok : cbor_efmt;
+  size_t pos, len;
+
+  put_head(chunks, 0x60, s.size());
+  chunks.insert(chunks.end(), s.begin(), s.end());
+
+  // a copy has memory of its exact size, so reads past the end are caught
+  data = std::vector<uint8_t>(chunks);
+  TEST_CHECK(cbdec_validate(data.data(), data.size(), CBOR_VALIDATE_UTF8) == expect);
+
+  cbdec_ctx_t mem = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size());
+  TEST_CHECK(decode(&mem) == expect);
+
+  // characters split between buffer fills and segments
+  source src = {&data, 0};
+  cbdec_ctx_t ra = CBOR_DECODER_BUF_CTX_INITIALIZER(fill, rabuf.data(), rabuf.size(), &src);
+  TEST_CHECK(decode(&ra) == expect);
+
+  for(pos = 0; pos < data.size(); pos += len) {
+    len = 1 + test_rand() % (test_rand() % 2? 5 : 80);
+    if(len > data.size() - pos) { len = data.size() - pos; }
+    iov.push_back({data.data() + pos, len});
+  }
+  cbdec_ctx_t v = CBOR_DECODER_IOV_CTX_INITIALIZER(iov.data(), iov.size());
+  TEST_CHECK(decode(&v) == expect);
+
+  // every chunk of a variable length string is checked on its own
+  chunks.assign(1, 0x7F);
+  for(pos = 0; pos < s.size(); pos += len) {
+    len = test_rand() % 70;
+    if(len > s.size() - pos) { len = s.size() - pos; }
+    cvalid = cvalid && ref_valid(s.data() + pos, len);
+
+    put_head(chunks, 0x60, len);
+    chunks.insert(chunks.end(), s.begin() + pos, s.begin() + pos + len);
+  }
+  chunks.push_back(0xFF);
+
+  data = std::vector<uint8_t>(chunks);
+  expect = cvalid? cbor_ok : cbor_efmt;
+  TEST_CHECK(cbdec_validate(data.data(), data.size(), CBOR_VALIDATE_UTF8) == expect);
+
+  cbdec_ctx_t vm = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size());
+  TEST_CHECK(decode(&vm) == expect);
+}
+
+// scalar prefix as the encoder computes it: NUL, character limit and structure of sequences
+static size_t ref_prefix(const uint8_t *s, cbor_uint char_limit)
+{
+  size_t i, n, len = 0;
+
+  while(s[len] && char_limit--) {
+    n = 1;
+    if(s[len] > 127) {
+      if     ((s[len] & 0xE0) == 0xC0) { n += 1; }
+      else if((s[len] & 0xF0) == 0xE0) { n += 2; }
+      else if((s[len] & 0xF8) == 0xF0) { n += 3; }
+      else if((s[len] & 0xFC) == 0xF8) { n += 4; }
+      else if((s[len] & 0xFE) == 0xFC) { n += 5; }
+      else                             { break;  }
+    }
+
+    for(i = 1; i < n; i++) {
+      if((s[len + i] & 0xC0) != 0x80) { return len; }
+    }
+
+    len += n;
+  }
+
+  return len;
+}
+
+static void check_encode(const std::vector<uint8_t> &s)
+{
+  std::vector<uint8_t> ref, buf(64);
+  size_t len, sz;
+
+  // NUL terminated copy of exact size, as a c-string owned by the caller
+  uint8_t *str = new uint8_t[s.size() + 1];
+  if(!s.empty()) { std::memcpy(str, s.data(), s.size()); }
+  str[s.size()] = 0;
+
+  len = ref_prefix(str, ~static_cast<cbor_uint>(0));
+  put_head(ref, 0x60, len);
+  ref.insert(ref.end(), str, str + len);
+
+  cbenc_ctx_t c = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+  test_out.clear();
+  cbenc_begin(&c);
+  TEST_CHECK(cbenc_cstring(&c, reinterpret_cast<const char*>(str)) == cbor_ok);
+  TEST_CHECK(cbenc_end(&c) == cbor_ok && test_out == ref);
+
+  // the size limits characters, vector loads must not read past it
+  sz = s.empty()? 0 : test_rand() % (s.size() + 1);
+  if(test_rand() % 2) { sz = s.size(); }
+
+  len = ref_prefix(str, sz);
+  ref.clear();
+  put_head(ref, 0x60, len);
+  ref.insert(ref.end(), str, str + len);
+
+  cbenc_ctx_t t = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf.data(), buf.size(), nullptr);
+  test_out.clear();
+  cbenc_begin(&t);
+  TEST_CHECK(cbenc_textstr(&t, reinterpret_cast<const char*>(str), sz) == cbor_ok);
+  TEST_CHECK(cbenc_end(&t) == cbor_ok && test_out == ref);
+
+  delete[] str;
+}
+
+int main(int, char**)
+{
+  // around the 16 and 32 byte blocks of the vector code and the 8 byte ASCII step
+  static const size_t sizes[] = {0, 1, 2, 3, 4, 7, 8, 9, 15, 16, 17, 30, 31, 32, 33, 34, 47, 48,
+                                 49, 63, 64, 65, 95, 96, 97, 127, 128, 129, 255, 256, 1000};
+  uint32_t it;
+
+  for(it = 0; it < 20000; it++) {
+    test_seed = it;
+
+    std::vector<uint8_t> s = make_text(sizes[it % (sizeof(sizes) / sizeof(sizes[0]))]);
+    if(it % 3) { damage(s); }
+
+    check(s);
+
+    // NUL inside the string
+    if(it % 7 == 0 && !s.empty()) { s[test_rand() % s.size()] = 0; }
+    check_encode(s);
+  }
+
+  return test_result("utf8");
+}
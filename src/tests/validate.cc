@@ -0,0 +1,145 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "cbor-test.h"
+
+static cbtape_item_t tape_items[4096];
+
+// decoder pass over the data: every item skipped and the tape index built
+static bool decodes(const std::vector<uint8_t> &data)
+{
+  cbdec_ctx_t ctx = CBOR_DECODER_MEM_CTX_INITIALIZER(data.data(), data.size());
+  cbtape_t tape = CBOR_TAPE_INITIALIZER(tape_items, sizeof(tape_items) / sizeof(tape_items[0]));
+
+  if(cbdec_step(&ctx) != cbor_ok || cbdec_skip(&ctx) != cbor_ok || ctx.pos != ctx.end) {
+    return false;
+  }
+
+  return cbtape_parse(&tape, data.data(), data.size()) == cbor_ok;
+}
+
+static bool parse_hex(const std::string &hex, std::vector<uint8_t> &data)
+{
+  data.clear();
+  if(hex == "-") { return true; }
+  if(hex.size() % 2) { return false; }
+
+  for(size_t i = 0; i < hex.size(); i += 2) {
+    data.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+  }
+
+  return true;
+}
+
+static void check_corpus(const char *path)
+{
+  static const char *names[] = {"ok", "eos", "efmt", "eio", "enomem", "eagain"};
+  std::ifstream in(path);
+  std::string line, expected, hex;
+  std::vector<uint8_t> data;
+  unsigned flags, count = 0;
+
+  TEST_CHECK(in.is_open());
+
+  while(std::getline(in, line)) {
+    if(line.empty() || line[0] == '#') { continue; }
+
+    std::istringstream fields(line);
+    TEST_CHECK(fields >> expected >> flags >> hex && parse_hex(hex, data));
+
+    cbor_status cs = cbdec_validate(data.data(), data.size(), flags);
+    if(expected != names[cs]) { std::printf("%s: got %s\n", line.c_str(), names[cs]); }
+    TEST_CHECK(expected == names[cs]);
+
+    // decoders must accept whatever validates, and reject the malformed counts as well
+    if(flags == 0 && !data.empty()) { TEST_CHECK(decodes(data) == (cs == cbor_ok)); }
+
+    count++;
+  }
+
+  TEST_CHECK(count > 0);
+}
+
+// random document, encoded with known counts
+static void make_doc(cbenc_ctx_t *ctx, int depth)
+{
+  static const char text[] = "text \xC3\xA9";
+  uint32_t i, n;
+
+  switch(test_rand() % (depth > 3? 5 : 8)) {
+  case 0: cbenc_uint(ctx, test_rand() << (test_rand() % 24)); break;
+  case 1: cbenc_int(ctx, -static_cast<cbor_int>(test_rand())); break;
+  case 2: cbenc_textstr(ctx, text, test_rand() % sizeof(text)); break;
+  case 3: cbenc_float64(ctx, test_rand() / 3.0); break;
+  case 4: cbenc_simple(ctx, cbor_null); break;
+
+  case 5:
+    n = test_rand() % 6;
+    cbenc_array(ctx, n);
+    for(i = 0; i < n; i++) { make_doc(ctx, depth + 1); }
+    break;
+
+  case 6:
+    cbenc_map_begin(ctx);
+    for(i = test_rand() % 4; i > 0; i--) { cbenc_uint(ctx, i); make_doc(ctx, depth + 1); }
+    cbenc_break(ctx);
+    break;
+
+  default:
+    cbenc_bytestr_begin(ctx);
+    for(i = test_rand() % 3; i > 0; i--) { cbenc_bytestr(ctx, text, i); }
+    cbenc_break(ctx);
+    break;
+  }
+}
+
+// mutated documents: whatever validates must decode
+static void check_mutations()
+{
+  static const uint8_t counts[] = {0x9B, 0xBB, 0x5B, 0x7B};
+  uint8_t buf[64];
+  std::vector<uint8_t> data;
+  size_t i, pos;
+
+  for(i = 0; i < 20000; i++) {
+    cbenc_ctx_t ctx = CBOR_ENCODER_CTX_INITIALIZER(test_write, buf, sizeof(buf), nullptr);
+
+    test_out.clear();
+    cbenc_begin(&ctx);
+    make_doc(&ctx, 0);
+    cbenc_end(&ctx);
+
+    data = test_out;
+    TEST_CHECK(cbdec_validate(data.data(), data.size(), CBOR_VALIDATE_UTF8) == cbor_ok);
+    TEST_CHECK(decodes(data));
+
+    pos = test_rand() % data.size();
+
+    switch(test_rand() % 4) {
+    case 0: data[pos] ^= 1 << (test_rand() % 8); break;
+    case 1: data.resize(pos); break;
+    case 2: data.insert(data.begin() + pos, static_cast<uint8_t>(test_rand())); break;
+
+    default:
+      // the largest count
+      data.insert(data.begin() + pos, 8, 0xFF);
+      data.insert(data.begin() + pos, counts[test_rand() % 4]);
+      break;
+    }
+
+    if(cbdec_validate(data.data(), data.size(), 0) == cbor_ok) { TEST_CHECK(decodes(data)); }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 2) {
+    std::printf("usage: %s validate-corpus.txt\n", argv[0]);
+    return 2;
+  }
+
+  check_corpus(argv[1]);
+  check_mutations();
+
+  return test_result("validate");
+}
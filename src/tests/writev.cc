@@ -0,0 +1,168 @@
+#include <cstring>
+#include "cbor-test.h"
+
+// referenced data must stay the same until it is written, so it is never changed
+static uint8_t blob[20000];
+static uint32_t uints[64];
+static const char text[] = "text \xC3\xA9";
+
+// items of at least CBOR_ENCODER_IOV_REF_SIZE bytes outside open containers
+static size_t expect_refs;
+static int held;
+
+struct sink
+{
+  const uint8_t *buf;
+  cbor_uint bufsz;
+  size_t iovmax;
+  size_t calls;
+  size_t refs;
+  size_t fail_at;
+};
+
+static cbor_status writev(const cbor_iovec_t *iov, size_t n, void *usrdata)
+{
+  sink *s = static_cast<sink*>(usrdata);
+  const uint8_t *p;
+
+  if(++s->calls == s->fail_at) { return cbor_eio; }
+
+  TEST_CHECK(n > 0 && n <= s->iovmax);
+
+  for(size_t i = 0; i < n; i++) {
+    p = static_cast<const uint8_t*>(iov[i].base);
+    TEST_CHECK(iov[i].len > 0);
+
+    // a segment is either caller data or buffer data, nothing else: strings that do not fit
+    // the buffer are passed as they are, also the short ones
+    if(p >= blob && p + iov[i].len <= blob + sizeof(blob)) {
+      s->refs += iov[i].len >= CBOR_ENCODER_IOV_REF_SIZE;
+    }
+    else if(p != reinterpret_cast<const uint8_t*>(text)) {
+      TEST_CHECK(p >= s->buf && p + iov[i].len <= s->buf + s->bufsz);
+    }
+
+    test_write(p, iov[i].len, nullptr);
+  }
+
+  return cbor_ok;
+}
+
+static cbor_status bytestr(cbenc_ctx_t *ctx, cbor_uint sz)
+{
+  if(sz >= CBOR_ENCODER_IOV_REF_SIZE && !held) { expect_refs++; }
+  return cbenc_bytestr(ctx, blob + test_rand() % (sizeof(blob) - sz), sz);
+}
+
+// random items, strings around the reference size, the status of the first failed call
+static cbor_status encode(cbenc_ctx_t *ctx, bool open, int depth)
+{
+  cbor_status cs = cbor_ok;
+  cbor_uint mark, i, n = test_rand() % (depth? 6 : 40);
+
+  while(n-- > 0 && cs == cbor_ok) {
+    switch(test_rand() % ((depth > 2)? 7 : (open? 10 : 9))) {
+    case 0: cs = cbenc_uint(ctx, static_cast<cbor_uint>(test_rand()) << test_rand() % 40); break;
+    case 1: cs = cbenc_cstring(ctx, text); break;
+    case 2: cs = bytestr(ctx, CBOR_ENCODER_IOV_REF_SIZE - 2 + test_rand() % 4); break;
+    case 3: cs = bytestr(ctx, test_rand() % ((test_rand() % 8)? 60 : 8000)); break;
+
+    case 4:
+      // byte order changed in the buffer, not referenced
+      cs = cbenc_typed_array(ctx, cbor_tag_ta_u32be, uints, test_rand() % 64);
+      break;
+
+    case 5:
+      i = test_rand() % 300;
+      if(i >= CBOR_ENCODER_IOV_REF_SIZE && !held) { expect_refs++; }
+      cs = cbenc_typed_array(ctx, cbor_tag_ta_u8, blob, i);
+      break;
+
+    case 6:
+      cs = cbenc_bytestr_begin(ctx);
+      for(i = test_rand() % 4; i > 0 && cs == cbor_ok; i--) {
+        cs = bytestr(ctx, test_rand() % 400);
+      }
+      if(cs == cbor_ok) { cs = cbenc_break(ctx); }
+      break;
+
+    case 7:
+    case 8:
+      cs = cbenc_array(ctx, 3);
+      for(i = 0; i < 3 && cs == cbor_ok; i++) { cs = encode(ctx, open, depth + 3); }
+      break;
+
+    default:
+      // data of open containers is copied
+      held++;
+      cs = cbenc_map_open(ctx, &mark);
+      if(cs == cbor_ok) { cs = cbenc_uint(ctx, 1); }
+      if(cs == cbor_ok) { cs = encode(ctx, open, depth + 1); }
+      if(cs == cbor_ok) { cs = cbenc_uint(ctx, 2); }
+      if(cs == cbor_ok) { cs = cbenc_close(ctx, mark, 1 + (test_rand() % 2)); }
+      held--;
+      break;
+    }
+  }
+
+  return cs;
+}
+
+int main(int, char**)
+{
+  static const cbor_uint bufs[] = {CBOR_ENCODER_MIN_BUFFER_SIZE, 10, 64, 200, 1000, 5000};
+  static const size_t iovmaxs[] = {1, 2, 3, 4, 8, 64};
+  std::vector<uint8_t> big(1 << 24), ref, buf;
+  std::vector<cbor_iovec_t> iov;
+  cbor_status cs;
+  uint32_t it;
+  bool open;
+
+  for(size_t i = 0; i < sizeof(blob); i++) { blob[i] = static_cast<uint8_t>(i * 7 + i / 251); }
+  for(size_t i = 0; i < 64; i++) { uints[i] = static_cast<uint32_t>(i * i * 12345); }
+
+  for(it = 0; it < 7200; it++) {
+    open = it % 3 == 0;
+
+    cbenc_ctx_t w = CBOR_ENCODER_CTX_INITIALIZER(test_write, big.data(), big.size(), nullptr);
+    test_seed = it;
+    test_out.clear();
+    cbenc_begin(&w);
+    TEST_CHECK(encode(&w, open, 0) == cbor_ok && cbenc_end(&w) == cbor_ok);
+    ref = test_out;
+
+    // every buffer and segment list size, the list may be too short to reference anything
+    buf.assign(bufs[it % 6], 0);
+    iov.resize(iovmaxs[it / 6 % 6]);
+
+    sink s = {buf.data(), buf.size(), iov.size(), 0, 0, 0};
+    cbenc_ctx_t v = CBOR_ENCODER_IOV_CTX_INITIALIZER(writev, buf.data(), buf.size(), iov.data(),
+                                                     iov.size(), &s);
+    test_seed = it;
+    test_out.clear();
+    expect_refs = 0;
+    cbenc_begin(&v);
+    cs = encode(&v, open, 0);
+    if(cs == cbor_ok) { cs = cbenc_end(&v); }
+
+    // open containers may not fit a small buffer
+    if(cs != cbor_ok) { TEST_CHECK(cs == cbor_enomem && open); continue; }
+
+    TEST_CHECK(test_out == ref && cbenc_size(&v) == ref.size());
+    // large data is referenced with room for three segments, data of open containers never
+    if(iov.size() >= 3) { TEST_CHECK(s.refs == expect_refs); }
+    else { TEST_CHECK(s.refs <= expect_refs); }
+
+    // a failed write is returned by the call that flushed
+    s = {buf.data(), buf.size(), iov.size(), 0, 0, 1 + test_rand() % (s.calls + 1)};
+    cbenc_ctx_t f = CBOR_ENCODER_IOV_CTX_INITIALIZER(writev, buf.data(), buf.size(), iov.data(),
+                                                     iov.size(), &s);
+    test_seed = it;
+    cbenc_begin(&f);
+    cs = encode(&f, open, 0);
+    if(cs == cbor_ok) { cs = cbenc_end(&f); }
+    TEST_CHECK(cs == ((s.fail_at <= s.calls)? cbor_eio : cbor_ok));
+  }
+
+  return test_result("writev");
+}